@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "capture.h"
+#include "capture_index.h"
+#include "timebase.h"
+
+static int capture_reserve(capture_writer_t *w, uint64_t needed)
+{
+    uint64_t new_size = w->allocated;
+
+    while (new_size < needed)
+        new_size += CAPTURE_EXTENT;
+
+    if (new_size == w->allocated)
+        return 0;
+
+    /* posix_fallocate() reserves the blocks up-front, so appending never has to wait for the
+     * filesystem to find space, fall back to a sparse extension where it is not supported */
+    if ((posix_fallocate(w->fd, w->allocated, new_size - w->allocated) != 0) &&
+        (ftruncate(w->fd, new_size) != 0))
+        return -1;
+
+    w->allocated = new_size;
+    return 0;
+}
+
+/* w = writer to initialize
+ * path = capture file to create, an existing file is truncated */
+int capture_open(capture_writer_t *w, const char *path)
+{
+    return capture_open_at(w, path, timebase_now_ns(), timebase_realtime_ns());
+}
+
+/* Same with the start times of another capture, for the records copied from it (extracts, flight
+ * recorder dumps): their timestamps stay relative to the original start */
+int capture_open_at(capture_writer_t *w, const char *path, uint64_t start_mono_ns, uint64_t start_real_ns)
+{
+    capture_header_t hdr = {0};
+
+    memset(w, 0, sizeof(*w));
+    w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0)
+        return -1;
+
+    strncpy(hdr.magic, CAPTURE_MAGIC, sizeof(hdr.magic));
+    hdr.version = CAPTURE_VERSION;
+    hdr.header_size = sizeof(capture_header_t);
+    hdr.data_end = sizeof(capture_header_t);
+    hdr.start_mono_ns = start_mono_ns;
+    hdr.start_real_ns = start_real_ns;
+
+    if ((capture_reserve(w, CAPTURE_EXTENT) != 0) ||
+        (pwrite(w->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)))
+    {
+        close(w->fd);
+        w->fd = -1;
+        return -1;
+    }
+
+    /* the capture is still usable without its index, queries then fall back to a linear scan */
+    w->index = malloc(sizeof(capture_index_writer_t));
+    if (w->index && (capture_index_open(w->index, path) != 0))
+    {
+        free(w->index);
+        w->index = NULL;
+    }
+
+    w->end = sizeof(capture_header_t);
+    w->committed = w->end;
+    return 0;
+}
+
+/* Append one framed record, the record only becomes visible to readers after capture_commit() */
+int capture_write(capture_writer_t *w, uint64_t timestamp_ns, uint16_t probe, uint8_t channel, uint8_t type,
+                  const uint8_t *data, uint32_t len)
+{
+    static const uint8_t pad[CAPTURE_ALIGN] = {0};
+    capture_record_t rec;
+    struct iovec iov[3];
+    uint64_t size = CAPTURE_RECORD_SIZE(len);
+
+    if (w->fd < 0)
+        return -1;
+
+    if (capture_reserve(w, w->end + size) != 0)
+        return -1;
+
+    rec.timestamp_ns = timestamp_ns;
+    rec.probe = probe;
+    rec.channel = channel;
+    rec.type = type;
+    rec.length = len;
+
+    iov[0].iov_base = &rec;
+    iov[0].iov_len = sizeof(rec);
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len = len;
+    iov[2].iov_base = (void *)pad;
+    iov[2].iov_len = size - sizeof(rec) - len;
+
+    if (pwritev(w->fd, iov, 3, w->end) != (ssize_t)size)
+        return -1;
+
+    if (w->index)
+        capture_index_add(w->index, w->end, &rec);
+
+    w->end += size;
+    return 0;
+}
+
+/* Publish everything written so far by moving header.data_end, called once per poll cycle */
+int capture_commit(capture_writer_t *w)
+{
+    if ((w->fd < 0) || (w->committed == w->end))
+        return 0;
+
+    if (w->index)
+        capture_index_flush(w->index);
+
+    if (pwrite(w->fd, &w->end, sizeof(w->end), offsetof(capture_header_t, data_end)) != sizeof(w->end))
+        return -1;
+
+    w->committed = w->end;
+    return 0;
+}
+
+void capture_close(capture_writer_t *w)
+{
+    if (w->fd < 0)
+        return;
+
+    capture_commit(w);
+    if (w->index)
+    {
+        capture_index_close(w->index);
+        free(w->index);
+        w->index = NULL;
+    }
+    /* give back the unused part of the last extent */
+    if (ftruncate(w->fd, w->end) != 0)
+    {
+        /* the file is still valid, data_end tells readers where to stop */
+    }
+    close(w->fd);
+    w->fd = -1;
+}
+
+/* m = map descriptor to initialize
+ * path = capture file to open read-only, the records are accessed in place */
+int capture_map(capture_map_t *m, const char *path)
+{
+    struct stat st;
+    int fd;
+
+    memset(m, 0, sizeof(*m));
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(capture_header_t)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    m->size = st.st_size;
+    m->base = mmap(NULL, m->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping keeps its own reference to the file */
+    if (m->base == MAP_FAILED)
+    {
+        m->base = NULL;
+        return -1;
+    }
+
+    m->hdr = (const capture_header_t *)m->base;
+    if ((strncmp(m->hdr->magic, CAPTURE_MAGIC, sizeof(m->hdr->magic)) != 0) ||
+        (m->hdr->version != CAPTURE_VERSION) ||
+        (m->hdr->header_size < sizeof(capture_header_t)))
+    {
+        capture_unmap(m);
+        return -1;
+    }
+
+    m->end = m->hdr->data_end;
+    if (m->end > m->size)
+        m->end = m->size;
+
+    madvise((void *)m->base, m->size, MADV_SEQUENTIAL);
+    return 0;
+}
+
+void capture_unmap(capture_map_t *m)
+{
+    if (m->base)
+        munmap((void *)m->base, m->size);
+    memset(m, 0, sizeof(*m));
+}
+
+/* Returns the record at *offset and moves *offset to the next one,
+ * NULL at the end of the committed data or if the record would run past it */
+const capture_record_t *capture_next(const capture_map_t *m, uint64_t *offset)
+{
+    const capture_record_t *rec;
+
+    if (*offset < m->hdr->header_size)
+        *offset = m->hdr->header_size;
+
+    if (*offset + sizeof(capture_record_t) > m->end)
+        return NULL;
+
+    rec = (const capture_record_t *)(m->base + *offset);
+    if (*offset + CAPTURE_RECORD_SIZE(rec->length) > m->end)
+        return NULL;
+
+    *offset += CAPTURE_RECORD_SIZE(rec->length);
+    return rec;
+}
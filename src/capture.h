@@ -0,0 +1,86 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Binary capture file layout:
+ *
+ *   capture_header_t                                  (64 bytes, at offset 0)
+ *   capture_record_t + payload (padded to 8 bytes)    (repeated, append only)
+ *
+ * The file is grown in CAPTURE_EXTENT steps so the writer never extends it on every record,
+ * header.data_end marks the end of the last committed record, anything after it is preallocated
+ * space (or a record that was being written when the host died) and must be ignored by readers.
+ * All fields are little endian, as written by the host. */
+
+#define CAPTURE_MAGIC "YRTTCAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_EXTENT (64u * 1024u * 1024u)
+#define CAPTURE_ALIGN 8
+
+/* capture_record_t.type */
+#define CAPTURE_REC_DATA 0    /* payload is raw data drained from an up channel */
+#define CAPTURE_REC_TRIGGER 1 /* payload is the text describing why a trigger fired, see trigger.h */
+#define CAPTURE_REC_CLOCK 2   /* payload is a clocksync_sample_t (CYCCNT <-> host time pair), see clocksync.h */
+#define CAPTURE_REC_FRAME 3   /* payload is one frame of a framed channel, without its CRC and sequence byte, see frame.h */
+#define CAPTURE_REC_BOOT 4    /* payload is the host boot id, a flight recorder history resumed after a reboot, see flight.h */
+
+typedef struct
+{
+    char magic[8];          // CAPTURE_MAGIC, NUL terminated
+    uint32_t version;       // CAPTURE_VERSION
+    uint32_t header_size;   // sizeof(capture_header_t), offset of the first record
+    uint64_t data_end;      // file offset right after the last committed record
+    uint64_t start_mono_ns; // host CLOCK_MONOTONIC when the capture was created
+    uint64_t start_real_ns; // host CLOCK_REALTIME at the same instant, to convert record timestamps to wall time
+    uint8_t reserved[24];
+} capture_header_t;
+
+typedef struct
+{
+    uint64_t timestamp_ns; // host CLOCK_MONOTONIC when the chunk was drained
+    uint16_t probe;        // index of the probe the chunk came from
+    uint8_t channel;       // up channel index
+    uint8_t type;          // CAPTURE_REC_xxx
+    uint32_t length;       // payload length in bytes, not including the padding
+} capture_record_t;
+
+#define CAPTURE_RECORD_SIZE(len) (sizeof(capture_record_t) + (((len) + CAPTURE_ALIGN - 1) & ~(uint64_t)(CAPTURE_ALIGN - 1)))
+
+typedef struct capture_index_writer capture_index_writer_t;
+
+typedef struct
+{
+    int fd;
+    capture_index_writer_t *index; // sparse index updated with every record, see capture_index.h
+    uint64_t end;       // offset where the next record will be written
+    uint64_t committed; // data_end value currently stored in the header
+    uint64_t allocated; // preallocated file size
+} capture_writer_t;
+
+typedef struct
+{
+    const uint8_t *base;
+    size_t size;
+    const capture_header_t *hdr;
+    uint64_t end; // validated data_end
+} capture_map_t;
+
+int capture_open(capture_writer_t *w, const char *path);
+int capture_open_at(capture_writer_t *w, const char *path, uint64_t start_mono_ns, uint64_t start_real_ns);
+int capture_write(capture_writer_t *w, uint64_t timestamp_ns, uint16_t probe, uint8_t channel, uint8_t type,
+                  const uint8_t *data, uint32_t len);
+int capture_commit(capture_writer_t *w);
+void capture_close(capture_writer_t *w);
+
+int capture_map(capture_map_t *m, const char *path);
+void capture_unmap(capture_map_t *m);
+const capture_record_t *capture_next(const capture_map_t *m, uint64_t *offset);
+
+static inline const uint8_t *capture_payload(const capture_record_t *rec)
+{
+    return (const uint8_t *)(rec + 1);
+}
+
+#endif
@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "capture_index.h"
+
+static char *capture_index_path(const char *capture_path)
+{
+    char *path = malloc(strlen(capture_path) + 5);
+
+    if (path)
+        sprintf(path, "%s.idx", capture_path);
+    return path;
+}
+
+/* iw = index writer to initialize
+ * capture_path = path of the capture file, the index is created as <capture_path>.idx */
+int capture_index_open(capture_index_writer_t *iw, const char *capture_path)
+{
+    capture_index_header_t hdr = {0};
+    char *path = capture_index_path(capture_path);
+
+    memset(iw, 0, sizeof(*iw));
+    if (path == NULL)
+        return -1;
+
+    iw->f = fopen(path, "wb");
+    free(path);
+    if (iw->f == NULL)
+        return -1;
+
+    strncpy(hdr.magic, CAPTURE_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = CAPTURE_INDEX_VERSION;
+    hdr.stride = CAPTURE_INDEX_STRIDE;
+    fwrite(&hdr, sizeof(hdr), 1, iw->f);
+    return 0;
+}
+
+static void capture_index_put(capture_index_writer_t *iw, uint64_t offset, const capture_record_t *rec, uint16_t channel)
+{
+    capture_index_entry_t e = {0};
+
+    e.timestamp_ns = rec->timestamp_ns;
+    e.offset = offset;
+    e.channel = channel;
+    e.probe = rec->probe;
+    fwrite(&e, sizeof(e), 1, iw->f);
+}
+
+/* Called by the capture writer for every record, offset = capture file offset of rec */
+void capture_index_add(capture_index_writer_t *iw, uint64_t offset, const capture_record_t *rec)
+{
+    if (iw->f == NULL)
+        return;
+
+    if (offset >= iw->block_end)
+    {
+        capture_index_put(iw, offset, rec, CAPTURE_INDEX_TIME);
+        iw->block_end = offset + CAPTURE_INDEX_STRIDE;
+        memset(iw->seen, 0, sizeof(iw->seen));
+    }
+
+    if ((iw->seen[rec->channel / 32] & (1u << (rec->channel % 32))) == 0)
+    {
+        capture_index_put(iw, offset, rec, rec->channel);
+        iw->seen[rec->channel / 32] |= 1u << (rec->channel % 32);
+    }
+}
+
+/* Must be called before the capture header publishes new records, so that the index always covers
+ * every committed record */
+void capture_index_flush(capture_index_writer_t *iw)
+{
+    if (iw->f)
+        fflush(iw->f);
+}
+
+void capture_index_close(capture_index_writer_t *iw)
+{
+    if (iw->f)
+        fclose(iw->f);
+    iw->f = NULL;
+}
+
+/* idx = index descriptor to initialize
+ * capture_path = path of the capture file whose index should be mapped */
+int capture_index_map(capture_index_t *idx, const char *capture_path)
+{
+    const capture_index_header_t *hdr;
+    struct stat st;
+    char *path = capture_index_path(capture_path);
+    int fd;
+
+    memset(idx, 0, sizeof(*idx));
+    if (path == NULL)
+        return -1;
+
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0)
+        return -1;
+
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(capture_index_header_t)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    idx->size = st.st_size;
+    idx->base = mmap(NULL, idx->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (idx->base == MAP_FAILED)
+    {
+        idx->base = NULL;
+        return -1;
+    }
+
+    hdr = (const capture_index_header_t *)idx->base;
+    if ((strncmp(hdr->magic, CAPTURE_INDEX_MAGIC, sizeof(hdr->magic)) != 0) || (hdr->version != CAPTURE_INDEX_VERSION))
+    {
+        capture_index_unmap(idx);
+        return -1;
+    }
+
+    idx->entries = (const capture_index_entry_t *)(hdr + 1);
+    idx->count = (idx->size - sizeof(*hdr)) / sizeof(capture_index_entry_t);
+    return 0;
+}
+
+void capture_index_unmap(capture_index_t *idx)
+{
+    if (idx->base)
+        munmap(idx->base, idx->size);
+    memset(idx, 0, sizeof(*idx));
+}
+
+/* Index of the last entry stamped strictly before t, every record before it is older than t.
+ * Returns -1 if the window starts before the first entry */
+static long capture_index_find(const capture_index_t *idx, uint64_t t)
+{
+    long lo = 0, hi = (long)idx->count - 1, found = -1;
+
+    while (lo <= hi)
+    {
+        long mid = lo + (hi - lo) / 2;
+
+        if (idx->entries[mid].timestamp_ns < t)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+/* Walk the records in [offset, end), returns 1 when the end of the window was reached */
+static int capture_query_scan(const capture_map_t *m, uint64_t offset, uint64_t end, uint64_t from_ns, uint64_t to_ns,
+                              int channel, capture_query_cb cb, void *ctx)
+{
+    const capture_record_t *rec;
+
+    while ((offset < end) && ((rec = capture_next(m, &offset)) != NULL))
+    {
+        if (rec->timestamp_ns > to_ns)
+            return 1;
+
+        if ((rec->timestamp_ns >= from_ns) && ((channel < 0) || (rec->channel == channel)))
+        {
+            if (cb(ctx, rec) != 0)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/* m = mapped capture file
+ * idx = its index, NULL (or an empty index) falls back to a linear scan
+ * from_ns, to_ns = inclusive window, in host monotonic time as stored in the records
+ * channel = channel to extract, -1 for all of them
+ * cb = called for every matching record, in file order */
+int capture_query(const capture_map_t *m, const capture_index_t *idx, uint64_t from_ns, uint64_t to_ns, int channel,
+                  capture_query_cb cb, void *ctx)
+{
+    long first;
+
+    if ((idx == NULL) || (idx->count == 0))
+    {
+        capture_query_scan(m, 0, m->end, from_ns, to_ns, channel, cb, ctx);
+        return 0;
+    }
+
+    first = capture_index_find(idx, from_ns);
+
+    if (channel < 0)
+    {
+        capture_query_scan(m, (first < 0) ? 0 : idx->entries[first].offset, m->end, from_ns, to_ns, channel, cb, ctx);
+        return 0;
+    }
+
+    /* the channel entry of the first block may come before the entry we found */
+    while ((first > 0) && (idx->entries[first].channel != CAPTURE_INDEX_TIME))
+        first--;
+
+    /* Only visit the blocks that have an entry for the channel, each one is scanned from the channel's
+     * first record up to the next block entry */
+    for (size_t i = (first < 0) ? 0 : (size_t)first; i < idx->count; i++)
+    {
+        const capture_index_entry_t *e = &idx->entries[i];
+        uint64_t block_end = m->end;
+
+        if (e->channel != channel)
+            continue;
+
+        if (e->offset >= m->end)
+            break;
+
+        if (e->timestamp_ns > to_ns)
+            break;
+
+        for (size_t j = i + 1; j < idx->count; j++)
+        {
+            if (idx->entries[j].channel == CAPTURE_INDEX_TIME)
+            {
+                block_end = idx->entries[j].offset;
+                break;
+            }
+        }
+
+        if (capture_query_scan(m, e->offset, block_end, from_ns, to_ns, channel, cb, ctx) != 0)
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef CAPTURE_INDEX_H
+#define CAPTURE_INDEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "capture.h"
+
+/* Sparse index kept next to a capture file (<capture>.idx):
+ *
+ *   capture_index_header_t
+ *   capture_index_entry_t    (repeated, append only, sorted by offset)
+ *
+ * The capture is split into blocks of CAPTURE_INDEX_STRIDE bytes. Every block starts with a time entry
+ * (channel = CAPTURE_INDEX_TIME) pointing at its first record, and the first record of each channel
+ * inside a block gets a channel entry, so a query only has to scan the blocks that actually contain
+ * the requested time window / channel. */
+
+#define CAPTURE_INDEX_MAGIC "YRTTIDX"
+#define CAPTURE_INDEX_VERSION 1
+#define CAPTURE_INDEX_STRIDE (256u * 1024u)
+#define CAPTURE_INDEX_TIME 0xFFFF
+
+typedef struct
+{
+    char magic[8];   // CAPTURE_INDEX_MAGIC, NUL terminated
+    uint32_t version; // CAPTURE_INDEX_VERSION
+    uint32_t stride;  // block size used by the writer
+} capture_index_header_t;
+
+typedef struct
+{
+    uint64_t timestamp_ns; // timestamp of the record at offset
+    uint64_t offset;       // capture file offset of the record
+    uint16_t channel;      // channel of the record, CAPTURE_INDEX_TIME for block entries
+    uint16_t probe;
+    uint32_t reserved;
+} capture_index_entry_t;
+
+struct capture_index_writer
+{
+    FILE *f;
+    uint64_t block_end;      // capture offset where the current block ends
+    uint32_t seen[256 / 32]; // channels that already have an entry in the current block
+};
+
+typedef struct
+{
+    const capture_index_entry_t *entries;
+    size_t count;
+    void *base;
+    size_t size;
+} capture_index_t;
+
+int capture_index_open(capture_index_writer_t *iw, const char *capture_path);
+void capture_index_add(capture_index_writer_t *iw, uint64_t offset, const capture_record_t *rec);
+void capture_index_flush(capture_index_writer_t *iw);
+void capture_index_close(capture_index_writer_t *iw);
+
+int capture_index_map(capture_index_t *idx, const char *capture_path);
+void capture_index_unmap(capture_index_t *idx);
+
+/* Callback for every record matching a query, return non-zero to stop */
+typedef int (*capture_query_cb)(void *ctx, const capture_record_t *rec);
+
+int capture_query(const capture_map_t *m, const capture_index_t *idx, uint64_t from_ns, uint64_t to_ns, int channel,
+                  capture_query_cb cb, void *ctx);
+
+#endif
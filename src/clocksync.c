@@ -0,0 +1,208 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <math.h>
+
+#include "clocksync.h"
+#include "timebase.h"
+
+void clocksync_init(clocksync_t *cs)
+{
+    memset(cs, 0, sizeof(*cs));
+    clocksync_set_wall(cs, timebase_now_ns(), timebase_realtime_ns());
+}
+
+void clocksync_set_wall(clocksync_t *cs, uint64_t mono_ns, uint64_t real_ns)
+{
+    cs->wall_offset_ns = (int64_t)(real_ns - mono_ns);
+}
+
+/* Make sure the cycle counter runs, it is stopped after a target reset */
+static int clocksync_enable(clocksync_t *cs, stlink_t *sl)
+{
+    uint32_t ctrl = 0, demcr = 0;
+
+    if (stlink_read_debug32(sl, DWT_CTRL, &ctrl) != 0)
+        return -1;
+
+    if (ctrl & DWT_CTRL_NOCYCCNT)
+    {
+        cs->unsupported = 1;
+        return -1;
+    }
+
+    if ((ctrl & DWT_CTRL_CYCCNTENA) == 0)
+    {
+        if ((stlink_read_debug32(sl, DEMCR, &demcr) != 0) ||
+            (stlink_write_debug32(sl, DEMCR, demcr | DEMCR_TRCENA) != 0) ||
+            (stlink_write_debug32(sl, DWT_CTRL, ctrl | DWT_CTRL_CYCCNTENA) != 0))
+            return -1;
+    }
+    return 0;
+}
+
+static double clocksync_predict(const clocksync_t *cs, uint64_t cycles)
+{
+    return (double)cs->ref_host_ns + cs->offset_ns + (double)(int64_t)(cycles - cs->ref_cycles) * cs->ns_per_cycle;
+}
+
+/* Least squares fit over the sample window, relative to the oldest sample to keep the precision */
+static void clocksync_fit(clocksync_t *cs)
+{
+    const clocksync_sample_t *ref = &cs->s[(cs->next + CLOCKSYNC_WINDOW - cs->count) % CLOCKSYNC_WINDOW];
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, err = 0, n = cs->count;
+    double mx, my, b;
+
+    for (uint32_t i = 0; i < cs->count; i++)
+    {
+        double x = (double)(int64_t)(cs->s[i].cycles - ref->cycles);
+        double y = (double)(int64_t)(cs->s[i].host_ns - ref->host_ns);
+
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+
+    mx = sx / n;
+    my = sy / n;
+    if (sxx - n * mx * mx <= 0)
+        return;
+
+    b = (sxy - n * mx * my) / (sxx - n * mx * mx);
+    if (b <= 0)
+        return;
+
+    cs->ref_cycles = ref->cycles;
+    cs->ref_host_ns = ref->host_ns;
+    cs->ns_per_cycle = b;
+    cs->offset_ns = my - b * mx;
+
+    for (uint32_t i = 0; i < cs->count; i++)
+    {
+        double d = (double)cs->s[i].host_ns - clocksync_predict(cs, cs->s[i].cycles);
+        err += d * d;
+    }
+    cs->residual_ns = sqrt(err / n);
+    cs->locked = (cs->count >= CLOCKSYNC_MIN_SAMPLES);
+}
+
+/* Start a new epoch, the counter restarted */
+static void clocksync_reset(clocksync_t *cs)
+{
+    cs->count = 0;
+    cs->next = 0;
+    cs->locked = 0;
+    cs->resets++;
+}
+
+static void clocksync_push(clocksync_t *cs, const clocksync_sample_t *smp)
+{
+    cs->last_raw = (uint32_t)smp->cycles;
+    cs->last_cycles = smp->cycles;
+    cs->last_host_ns = smp->host_ns;
+
+    cs->s[cs->next] = *smp;
+    cs->next = (cs->next + 1) % CLOCKSYNC_WINDOW;
+    if (cs->count < CLOCKSYNC_WINDOW)
+        cs->count++;
+
+    if (cs->count >= 2)
+        clocksync_fit(cs);
+}
+
+int clocksync_sample(clocksync_t *cs, stlink_t *sl, clocksync_sample_t *out)
+{
+    clocksync_sample_t smp;
+    uint64_t t0, t1;
+    uint32_t raw;
+
+    if (cs->unsupported)
+        return 0;
+
+    t0 = timebase_now_ns();
+    if (stlink_read_debug32(sl, DWT_CYCCNT, &raw) != 0)
+        return 0;
+    t1 = timebase_now_ns();
+
+    /* a counter that did not move is not running (first use or target reset) */
+    if (((cs->last_host_ns == 0) || (raw == cs->last_raw)) && (clocksync_enable(cs, sl) != 0))
+        return 0;
+
+    smp.rtt_ns = t1 - t0;
+    smp.host_ns = t0 + smp.rtt_ns / 2;
+
+    if ((cs->rtt_avg_ns > 0) && (smp.rtt_ns > 3 * cs->rtt_avg_ns))
+    {
+        /* delayed somewhere in the USB stack, the midpoint is not trustworthy */
+        cs->rtt_avg_ns = (7 * (uint64_t)cs->rtt_avg_ns + smp.rtt_ns) / 8;
+        return 0;
+    }
+    cs->rtt_avg_ns = cs->rtt_avg_ns ? (7 * (uint64_t)cs->rtt_avg_ns + smp.rtt_ns) / 8 : smp.rtt_ns;
+
+    if (cs->last_host_ns == 0)
+    {
+        smp.cycles = raw;
+    }
+    else
+    {
+        smp.cycles = cs->last_cycles + (uint32_t)(raw - cs->last_raw);
+
+        if (cs->locked)
+        {
+            /* the counter may have wrapped more than once while we were away */
+            double expected = (double)(smp.host_ns - cs->last_host_ns) / cs->ns_per_cycle;
+            double wraps = floor((expected - (double)(uint32_t)(raw - cs->last_raw)) / 4294967296.0 + 0.5);
+            double error;
+
+            if (wraps > 0)
+                smp.cycles += (uint64_t)wraps << 32;
+
+            error = fabs((double)smp.host_ns - clocksync_predict(cs, smp.cycles));
+            if (error > 1e6 + 100 * cs->residual_ns)
+            {
+                /* does not fit the model at all: the counter restarted, start a new epoch */
+                clocksync_reset(cs);
+                smp.cycles = raw;
+            }
+        }
+    }
+
+    clocksync_push(cs, &smp);
+
+    if (out)
+        *out = smp;
+    return 1;
+}
+
+void clocksync_add(clocksync_t *cs, const clocksync_sample_t *smp)
+{
+    /* the unwrapped count only goes back when the counter restarted, an epoch starts at the raw value */
+    if ((cs->count > 0) && ((smp->cycles < cs->last_cycles) ||
+                            (cs->locked && (fabs((double)smp->host_ns - clocksync_predict(cs, smp->cycles)) >
+                                            1e6 + 100 * cs->residual_ns))))
+        clocksync_reset(cs);
+
+    clocksync_push(cs, smp);
+}
+
+uint64_t clocksync_target_to_host(const clocksync_t *cs, uint32_t cycles)
+{
+    uint64_t c64 = cs->last_cycles + (int64_t)(int32_t)(cycles - cs->last_raw);
+
+    if (!cs->locked)
+        return 0;
+    return (uint64_t)clocksync_predict(cs, c64);
+}
+
+uint64_t clocksync_target_to_wall(const clocksync_t *cs, uint32_t cycles)
+{
+    uint64_t host_ns = clocksync_target_to_host(cs, cycles);
+
+    return host_ns ? host_ns + cs->wall_offset_ns : 0;
+}
+
+double clocksync_frequency(const clocksync_t *cs)
+{
+    return cs->locked ? 1e9 / cs->ns_per_cycle : 0;
+}
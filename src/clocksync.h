@@ -0,0 +1,68 @@
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+#include <stdint.h>
+
+#include <stlink.h>
+
+/* Host <-> target clock correlation based on the DWT cycle counter.
+ * Every poll CYCCNT is read with stlink_read_debug32(), the read is bracketed by two host monotonic
+ * timestamps and the midpoint is paired with the (unwrapped, 64 bit) cycle count. A least squares
+ * line host_ns = offset + cycles * ns_per_cycle is fitted over the last CLOCKSYNC_WINDOW samples,
+ * which follows the slow drift of the target oscillator against the host clock. Samples whose USB
+ * round trip is much slower than usual are dropped, they only add jitter. */
+
+#define CLOCKSYNC_WINDOW 64
+#define CLOCKSYNC_MIN_SAMPLES 4
+
+#define DWT_CTRL 0xE0001000
+#define DWT_CYCCNT 0xE0001004
+#define DEMCR 0xE000EDFC
+#define DEMCR_TRCENA (1 << 24)
+#define DWT_CTRL_CYCCNTENA (1 << 0)
+#define DWT_CTRL_NOCYCCNT (1 << 25)
+
+typedef struct
+{
+    uint64_t cycles;  // unwrapped CYCCNT
+    uint64_t host_ns; // host CLOCK_MONOTONIC at the middle of the read
+    uint32_t rtt_ns;  // round trip of the read
+} clocksync_sample_t;
+
+typedef struct
+{
+    clocksync_sample_t s[CLOCKSYNC_WINDOW];
+    uint32_t count; // valid samples in s
+    uint32_t next;  // next slot to overwrite
+    uint32_t last_raw;
+    uint64_t last_cycles;
+    uint64_t last_host_ns;
+    uint32_t rtt_avg_ns; // smoothed round trip, for outlier rejection
+    /* fitted model, host_ns = ref_host_ns + offset_ns + (cycles - ref_cycles) * ns_per_cycle, valid when locked */
+    uint64_t ref_cycles;
+    uint64_t ref_host_ns;
+    double ns_per_cycle;
+    double offset_ns;
+    double residual_ns; // RMS error of the fit
+    int locked;
+    int unsupported;    // the core has no cycle counter (Cortex-M0/M0+)
+    uint32_t resets;    // number of times the counter restarted (target reset)
+    int64_t wall_offset_ns; // host CLOCK_REALTIME - CLOCK_MONOTONIC, for the wall time conversion
+} clocksync_t;
+
+void clocksync_init(clocksync_t *cs);
+/* Take a sample, returns 1 when a new sample was added to the model (stored in *out if not NULL) */
+int clocksync_sample(clocksync_t *cs, stlink_t *sl, clocksync_sample_t *out);
+/* Add a recorded sample (CAPTURE_REC_CLOCK) to the model, to rebuild it offline from a capture */
+void clocksync_add(clocksync_t *cs, const clocksync_sample_t *smp);
+/* Pair of host monotonic/wall times used by clocksync_target_to_wall(), clocksync_init() takes the
+ * current ones, a capture gives its start_mono_ns/start_real_ns */
+void clocksync_set_wall(clocksync_t *cs, uint64_t mono_ns, uint64_t real_ns);
+/* Convert a 32 bit CYCCNT value captured by the target (close to the last sample) into host
+ * monotonic ns, 0 while the model is not locked */
+uint64_t clocksync_target_to_host(const clocksync_t *cs, uint32_t cycles);
+/* Same as clocksync_target_to_host() but in host wall time (CLOCK_REALTIME ns) */
+uint64_t clocksync_target_to_wall(const clocksync_t *cs, uint32_t cycles);
+double clocksync_frequency(const clocksync_t *cs);
+
+#endif
@@ -0,0 +1,223 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+
+#include "deflog.h"
+
+#define DEFLOG_MORE 1 /* the message is not complete yet */
+
+int deflog_init(deflog_t *d, const elf_symbols_t *elf, const char *section, deflog_sink_t sink, void *sink_ctx)
+{
+    uint32_t addr;
+
+    memset(d, 0, sizeof(*d));
+    d->fmt = (const char *)elf_section(elf, section, &d->fmt_size, &addr);
+    if ((d->fmt == NULL) || (d->fmt_size == 0))
+        return -1;
+
+    d->sink = sink;
+    d->sink_ctx = sink_ctx;
+    d->active = 1;
+    return 0;
+}
+
+static int deflog_uleb(const uint8_t *p, uint32_t len, uint32_t *pos, uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t b;
+
+        if (*pos >= len)
+            return DEFLOG_MORE;
+        b = p[(*pos)++];
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+            return 0;
+    }
+    return -1;
+}
+
+/* Render one message from p, returns 0 with *used set, DEFLOG_MORE, or -1 if it is not a message */
+static int deflog_message(deflog_t *d, const uint8_t *p, uint32_t len, uint32_t *used, size_t *text_len)
+{
+    uint32_t pos = 0;
+    uint64_t id, v;
+    const char *f;
+    size_t out = 0;
+    int err;
+
+    if ((err = deflog_uleb(p, len, &pos, &id)) != 0)
+        return err;
+    if ((id >= d->fmt_size) || (memchr(d->fmt + id, 0, d->fmt_size - id) == NULL))
+        return -1;
+
+    /* once the text is full the remaining arguments are still parsed, the message must be consumed
+     * whole to stay in sync with the stream */
+    for (f = d->fmt + id; *f; f++)
+    {
+        char spec[32];
+        size_t n = 0;
+        const char *start = f;
+        int w;
+
+        if (*f != '%')
+        {
+            if (out < DEFLOG_TEXT_MAX - 2)
+                d->text[out++] = *f;
+            continue;
+        }
+        if (f[1] == '%')
+        {
+            if (out < DEFLOG_TEXT_MAX - 2)
+                d->text[out++] = '%';
+            f++;
+            continue;
+        }
+
+        /* flags, width and precision are kept, length modifiers dropped */
+        spec[n++] = '%';
+        for (f++; *f && strchr("-+ #0123456789.", *f) && (n < sizeof(spec) - 4); f++)
+            spec[n++] = *f;
+        while (*f && strchr("hlLqjzt", *f))
+            f++;
+        if (*f == 0)
+            return -1;
+
+        switch (*f)
+        {
+        case 'd':
+        case 'i':
+            if ((err = deflog_uleb(p, len, &pos, &v)) != 0)
+                return err;
+            strcpy(spec + n, "lld");
+            w = snprintf(d->text + out, DEFLOG_TEXT_MAX - 1 - out, spec, (long long)((v >> 1) ^ -(v & 1)));
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+            if ((err = deflog_uleb(p, len, &pos, &v)) != 0)
+                return err;
+            spec[n++] = 'l';
+            spec[n++] = 'l';
+            spec[n++] = *f;
+            spec[n] = 0;
+            w = snprintf(d->text + out, DEFLOG_TEXT_MAX - 1 - out, spec, (unsigned long long)v);
+            break;
+        case 'c':
+            if ((err = deflog_uleb(p, len, &pos, &v)) != 0)
+                return err;
+            strcpy(spec + n, "c");
+            w = snprintf(d->text + out, DEFLOG_TEXT_MAX - 1 - out, spec, (int)v);
+            break;
+        case 'p':
+            if ((err = deflog_uleb(p, len, &pos, &v)) != 0)
+                return err;
+            w = snprintf(d->text + out, DEFLOG_TEXT_MAX - 1 - out, "0x%08llx", (unsigned long long)v);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        {
+            float fl;
+
+            if (pos + 4 > len)
+                return DEFLOG_MORE;
+            memcpy(&fl, p + pos, 4);
+            pos += 4;
+            spec[n++] = *f;
+            spec[n] = 0;
+            w = snprintf(d->text + out, DEFLOG_TEXT_MAX - 1 - out, spec, (double)fl);
+            break;
+        }
+        case 's':
+            if ((err = deflog_uleb(p, len, &pos, &v)) != 0)
+                return err;
+            if (v > DEFLOG_PENDING_MAX)
+                return -1;
+            if (pos + v > len)
+                return DEFLOG_MORE;
+            /* the string is not NUL terminated on the wire, its length replaces any precision */
+            if (memchr(spec, '.', n))
+                n = (char *)memchr(spec, '.', n) - spec;
+            strcpy(spec + n, ".*s");
+            w = snprintf(d->text + out, DEFLOG_TEXT_MAX - 1 - out, spec, (int)v, (const char *)p + pos);
+            pos += v;
+            break;
+        default:
+            /* unknown conversion, printed as is */
+            w = snprintf(d->text + out, DEFLOG_TEXT_MAX - 1 - out, "%.*s", (int)(f - start + 1), start);
+            break;
+        }
+
+        if (w > 0)
+            out += ((size_t)w < DEFLOG_TEXT_MAX - 1 - out) ? (size_t)w : DEFLOG_TEXT_MAX - 2 - out;
+    }
+
+    if ((out == 0) || (d->text[out - 1] != '\n'))
+        d->text[out++] = '\n';
+    *used = pos;
+    *text_len = out;
+    return 0;
+}
+
+void deflog_write(deflog_t *d, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    uint32_t start = 0;
+
+    if (!d->active)
+        return;
+
+    while (len > 0)
+    {
+        uint32_t n = DEFLOG_PENDING_MAX - d->pending_len;
+
+        if (n > len)
+            n = len;
+        memcpy(d->pending + d->pending_len, buf, n);
+        d->pending_len += n;
+        buf += n;
+        len -= n;
+
+        /* every complete message in pending */
+        start = 0;
+        while (start < d->pending_len)
+        {
+            uint32_t used;
+            size_t text_len;
+            int err = deflog_message(d, d->pending + start, d->pending_len - start, &used, &text_len);
+
+            if (err == DEFLOG_MORE)
+            {
+                /* a message can't be longer than the pending buffer, give up on this one */
+                if ((start > 0) || (d->pending_len < DEFLOG_PENDING_MAX))
+                    break;
+                err = -1;
+            }
+            if (err != 0)
+            {
+                /* lost sync (data dropped by the target), try again on the next byte */
+                d->errors++;
+                start++;
+                continue;
+            }
+
+            d->sink(d->sink_ctx, (const uint8_t *)d->text, text_len, ts_ns);
+            d->messages++;
+            start += used;
+        }
+
+        memmove(d->pending, d->pending + start, d->pending_len - start);
+        d->pending_len -= start;
+    }
+}
+
+void deflog_reset(deflog_t *d)
+{
+    d->pending_len = 0;
+}
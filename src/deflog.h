@@ -0,0 +1,49 @@
+#ifndef DEFLOG_H
+#define DEFLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "elf_symbols.h"
+
+/* Deferred formatting: the target only sends the ID of a format string and the raw arguments, the text
+ * is rendered here. The format strings are kept by the firmware in the DEFLOG_SECTION section of its
+ * ELF (not loaded on the target), the ID of a string is its byte offset in that section.
+ * Wire format of one message, integers as unsigned LEB128:
+ *   ID
+ *   then one field per conversion of the format string, in order:
+ *     %d %i        zigzag encoded LEB128
+ *     %u %x %X %o %c %p  LEB128
+ *     %f %e %g ... 4 byte IEEE float
+ *     %s           LEB128 length followed by the bytes
+ * Flags, width and precision are applied as printf would, length modifiers are ignored. A new line is
+ * added to messages that don't end with one. */
+
+#define DEFLOG_SECTION ".yrtt_fmt"
+#define DEFLOG_PENDING_MAX 4096 /* longest message */
+#define DEFLOG_TEXT_MAX 2048
+
+typedef void (*deflog_sink_t)(void *ctx, const uint8_t *buf, size_t len, uint64_t ts_ns);
+
+typedef struct
+{
+    const char *fmt; // section contents
+    uint32_t fmt_size;
+    uint8_t pending[DEFLOG_PENDING_MAX]; // message split between two reads
+    uint32_t pending_len;
+    char text[DEFLOG_TEXT_MAX];
+    deflog_sink_t sink;
+    void *sink_ctx;
+    uint64_t messages;
+    uint64_t errors; // bytes skipped to resynchronize
+    int active;
+} deflog_t;
+
+/* elf = firmware symbols, must stay loaded while decoding */
+int deflog_init(deflog_t *d, const elf_symbols_t *elf, const char *section, deflog_sink_t sink, void *sink_ctx);
+/* Decode the channel data received at host time ts_ns, complete messages go to the sink */
+void deflog_write(deflog_t *d, const uint8_t *buf, uint32_t len, uint64_t ts_ns);
+/* The stream restarted (target reset), drop the partial message */
+void deflog_reset(deflog_t *d);
+
+#endif
@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+
+#include "elf_symbols.h"
+
+static int elf_cmp_addr(const void *a, const void *b)
+{
+    const elf_symbol_t *sa = a, *sb = b;
+
+    if (sa->addr != sb->addr)
+        return (sa->addr < sb->addr) ? -1 : 1;
+    return 0;
+}
+
+static const Elf32_Shdr *elf_shdr(const elf_symbols_t *elf, uint32_t idx)
+{
+    const Elf32_Ehdr *eh = (const Elf32_Ehdr *)elf->image;
+
+    if ((idx >= eh->e_shnum) || (eh->e_shoff + (uint64_t)(idx + 1) * sizeof(Elf32_Shdr) > elf->image_size))
+        return NULL;
+    return (const Elf32_Shdr *)(elf->image + eh->e_shoff) + idx;
+}
+
+static int elf_in_image(const elf_symbols_t *elf, const Elf32_Shdr *sh)
+{
+    return (sh->sh_type == SHT_NOBITS) || ((uint64_t)sh->sh_offset + sh->sh_size <= elf->image_size);
+}
+
+/* elf = symbol table to fill
+ * path = firmware ELF file, kept in memory for the symbol names and sections */
+int elf_load(elf_symbols_t *elf, const char *path)
+{
+    const Elf32_Ehdr *eh;
+    FILE *f;
+    long size;
+
+    memset(elf, 0, sizeof(*elf));
+    f = fopen(path, "rb");
+    if (f == NULL)
+        return -1;
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    elf->image = malloc(size > 0 ? size : 1);
+    if ((elf->image == NULL) || (size < (long)sizeof(Elf32_Ehdr)) || (fread(elf->image, 1, size, f) != (size_t)size))
+    {
+        fclose(f);
+        elf_free(elf);
+        return -1;
+    }
+    fclose(f);
+    elf->image_size = size;
+
+    eh = (const Elf32_Ehdr *)elf->image;
+    if ((memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0) || (eh->e_ident[EI_CLASS] != ELFCLASS32) ||
+        (eh->e_ident[EI_DATA] != ELFDATA2LSB))
+    {
+        elf_free(elf);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < eh->e_shnum; i++)
+    {
+        const Elf32_Shdr *sh = elf_shdr(elf, i);
+        const Elf32_Shdr *strsh;
+        const Elf32_Sym *sym;
+        uint32_t n;
+        elf_symbol_t *grown;
+
+        if ((sh == NULL) || (sh->sh_type != SHT_SYMTAB) || !elf_in_image(elf, sh))
+            continue;
+
+        strsh = elf_shdr(elf, sh->sh_link);
+        if ((strsh == NULL) || !elf_in_image(elf, strsh))
+            continue;
+
+        sym = (const Elf32_Sym *)(elf->image + sh->sh_offset);
+        n = sh->sh_size / sizeof(Elf32_Sym);
+        grown = realloc(elf->syms, (elf->count + n) * sizeof(elf_symbol_t));
+        if (grown == NULL)
+            break;
+        elf->syms = grown;
+
+        for (uint32_t k = 0; k < n; k++)
+        {
+            int type = ELF32_ST_TYPE(sym[k].st_info);
+            elf_symbol_t *s;
+
+            if (((type != STT_FUNC) && (type != STT_OBJECT)) || (sym[k].st_name >= strsh->sh_size))
+                continue;
+
+            s = &elf->syms[elf->count++];
+            s->addr = (type == STT_FUNC) ? (sym[k].st_value & ~1u) : sym[k].st_value;
+            s->size = sym[k].st_size;
+            s->type = (type == STT_FUNC) ? ELF_SYM_FUNC : ELF_SYM_OBJECT;
+            s->name = (const char *)elf->image + strsh->sh_offset + sym[k].st_name;
+        }
+    }
+
+    qsort(elf->syms, elf->count, sizeof(elf_symbol_t), elf_cmp_addr);
+    return 0;
+}
+
+void elf_free(elf_symbols_t *elf)
+{
+    free(elf->image);
+    free(elf->syms);
+    memset(elf, 0, sizeof(*elf));
+}
+
+const elf_symbol_t *elf_find_function(const elf_symbols_t *elf, uint32_t addr)
+{
+    size_t lo = 0, hi = elf->count;
+
+    /* last symbol starting at or before addr */
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (elf->syms[mid].addr <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (size_t i = lo; i > 0; i--)
+    {
+        const elf_symbol_t *s = &elf->syms[i - 1];
+
+        if (s->type != ELF_SYM_FUNC)
+            continue;
+        /* functions don't overlap, the closest one below addr decides */
+        if ((addr < s->addr + s->size) || (s->size == 0))
+            return s;
+        break;
+    }
+    return NULL;
+}
+
+const elf_symbol_t *elf_find_name(const elf_symbols_t *elf, const char *name)
+{
+    for (size_t i = 0; i < elf->count; i++)
+    {
+        if (strcmp(elf->syms[i].name, name) == 0)
+            return &elf->syms[i];
+    }
+    return NULL;
+}
+
+const uint8_t *elf_section(const elf_symbols_t *elf, const char *name, uint32_t *size, uint32_t *addr)
+{
+    const Elf32_Ehdr *eh = (const Elf32_Ehdr *)elf->image;
+    const Elf32_Shdr *names = elf_shdr(elf, eh->e_shstrndx);
+
+    if ((names == NULL) || !elf_in_image(elf, names))
+        return NULL;
+
+    for (uint32_t i = 0; i < eh->e_shnum; i++)
+    {
+        const Elf32_Shdr *sh = elf_shdr(elf, i);
+
+        if ((sh == NULL) || (sh->sh_name >= names->sh_size) || (sh->sh_type == SHT_NOBITS) || !elf_in_image(elf, sh))
+            continue;
+
+        if (strcmp((const char *)elf->image + names->sh_offset + sh->sh_name, name) == 0)
+        {
+            *size = sh->sh_size;
+            *addr = sh->sh_addr;
+            return elf->image + sh->sh_offset;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef ELF_SYMBOLS_H
+#define ELF_SYMBOLS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Minimal reader for the firmware ELF (32 bit, little endian, as produced for Cortex-M targets):
+ * function and object symbols sorted by address, plus raw access to named sections */
+
+#define ELF_SYM_FUNC 0
+#define ELF_SYM_OBJECT 1
+
+typedef struct
+{
+    uint32_t addr; // thumb bit cleared
+    uint32_t size;
+    int type;      // ELF_SYM_xxx
+    const char *name;
+} elf_symbol_t;
+
+typedef struct
+{
+    uint8_t *image; // whole file
+    size_t image_size;
+    elf_symbol_t *syms;
+    size_t count;
+} elf_symbols_t;
+
+int elf_load(elf_symbols_t *elf, const char *path);
+void elf_free(elf_symbols_t *elf);
+/* Function containing addr, NULL if none */
+const elf_symbol_t *elf_find_function(const elf_symbols_t *elf, uint32_t addr);
+/* Symbol by name, NULL if none */
+const elf_symbol_t *elf_find_name(const elf_symbols_t *elf, const char *name);
+/* Contents and load address of a section, NULL if not present */
+const uint8_t *elf_section(const elf_symbols_t *elf, const char *name, uint32_t *size, uint32_t *addr);
+
+#endif
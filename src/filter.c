@@ -0,0 +1,189 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+#define FILTER_LINE_UNDECIDED 0
+#define FILTER_LINE_SHOW 1
+#define FILTER_LINE_HIDE 2
+
+#define FILTER_HL_ON "\x1b[1;31m"
+#define FILTER_HL_OFF "\x1b[0m"
+
+static void filter_start_line(filter_t *f)
+{
+    f->line = ((f->include | f->exclude) == 0) ? FILTER_LINE_SHOW : FILTER_LINE_UNDECIDED;
+    f->include_hit = 0;
+    f->state = 0;
+}
+
+/* Send the first n pending bytes to the sink */
+static void filter_flush(filter_t *f, size_t n)
+{
+    if (n == 0)
+        return;
+
+    f->sink(f->sink_ctx, f->pending, n);
+    memmove(f->pending, f->pending + n, f->pending_len - n);
+    f->pending_len -= n;
+    f->floor = (f->floor > n) ? f->floor - n : 0;
+}
+
+/* Wrap the last len raw bytes of pending in the highlight sequence */
+static void filter_highlight(filter_t *f, size_t len)
+{
+    size_t start = (f->pending_len > len) ? f->pending_len - len : 0;
+
+    if (start < f->floor)
+        start = f->floor;
+
+    memmove(f->pending + start + strlen(FILTER_HL_ON), f->pending + start, f->pending_len - start);
+    memcpy(f->pending + start, FILTER_HL_ON, strlen(FILTER_HL_ON));
+    f->pending_len += strlen(FILTER_HL_ON);
+    memcpy(f->pending + f->pending_len, FILTER_HL_OFF, strlen(FILTER_HL_OFF));
+    f->pending_len += strlen(FILTER_HL_OFF);
+    f->floor = f->pending_len;
+}
+
+/* f = filter to initialize
+ * sink = where the filtered stream goes */
+int filter_init(filter_t *f, filter_sink_t sink, void *sink_ctx)
+{
+    memset(f, 0, sizeof(*f));
+    if (match_init(&f->ac) != 0)
+        return -1;
+
+    f->sink = sink;
+    f->sink_ctx = sink_ctx;
+    return 0;
+}
+
+static int filter_add(filter_t *f, const char *escaped, uint32_t *mask)
+{
+    uint8_t *buf = malloc(strlen(escaped) + 1);
+    int id;
+
+    if (buf == NULL)
+        return -1;
+
+    id = match_add(&f->ac, buf, match_unescape(escaped, buf));
+    free(buf);
+    if (id < 0)
+        return -1;
+
+    *mask |= 1u << id;
+    return 0;
+}
+
+int filter_add_include(filter_t *f, const char *escaped)
+{
+    return filter_add(f, escaped, &f->include);
+}
+
+int filter_add_exclude(filter_t *f, const char *escaped)
+{
+    return filter_add(f, escaped, &f->exclude);
+}
+
+int filter_add_highlight(filter_t *f, const char *escaped)
+{
+    return filter_add(f, escaped, &f->highlight);
+}
+
+int filter_build(filter_t *f)
+{
+    if (match_build(&f->ac) != 0)
+        return -1;
+
+    filter_start_line(f);
+    f->active = 1;
+    return 0;
+}
+
+void filter_write(filter_t *f, const uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t c = buf[i];
+        uint32_t hit;
+
+        f->state = match_step(&f->ac, f->state, c);
+        hit = f->ac.out[f->state];
+
+        if (f->line != FILTER_LINE_HIDE)
+            f->pending[f->pending_len++] = c;
+
+        if (hit & f->exclude)
+        {
+            f->line = FILTER_LINE_HIDE;
+            f->pending_len = 0;
+            f->floor = 0;
+        }
+        else if ((hit != 0) && (f->line != FILTER_LINE_HIDE))
+        {
+            if (hit & f->include)
+            {
+                f->include_hit = 1;
+                if (f->exclude == 0)
+                    f->line = FILTER_LINE_SHOW;
+            }
+
+            if (hit & f->highlight)
+            {
+                size_t hl_len = 0;
+
+                for (uint32_t id = 0; id < f->ac.count; id++)
+                {
+                    if ((hit & f->highlight & (1u << id)) && (f->ac.len[id] > hl_len))
+                        hl_len = f->ac.len[id];
+                }
+                filter_highlight(f, hl_len);
+            }
+        }
+
+        if (c == '\n')
+        {
+            if (f->line == FILTER_LINE_UNDECIDED)
+                f->line = ((f->include == 0) || f->include_hit) ? FILTER_LINE_SHOW : FILTER_LINE_HIDE;
+            if (f->line == FILTER_LINE_SHOW)
+                filter_flush(f, f->pending_len);
+
+            f->pending_len = 0;
+            f->floor = 0;
+            filter_start_line(f);
+        }
+        else if (f->pending_len >= FILTER_PENDING_MAX)
+        {
+            /* can't hold more of this line, decide with what we know so far */
+            if (f->line == FILTER_LINE_UNDECIDED)
+                f->line = ((f->include != 0) && !f->include_hit) ? FILTER_LINE_HIDE : FILTER_LINE_SHOW;
+            if (f->line == FILTER_LINE_SHOW)
+                filter_flush(f, f->pending_len);
+
+            f->pending_len = 0;
+            f->floor = 0;
+        }
+    }
+
+    if (f->line == FILTER_LINE_SHOW)
+    {
+        /* keep back only what could still become the start of a highlighted match */
+        size_t hold = 0;
+
+        if (f->highlight != 0)
+        {
+            hold = f->ac.depth[f->state];
+            if (hold > f->pending_len - f->floor)
+                hold = f->pending_len - f->floor;
+        }
+        filter_flush(f, f->pending_len - hold);
+    }
+}
+
+void filter_free(filter_t *f)
+{
+    match_free(&f->ac);
+    memset(f, 0, sizeof(*f));
+}
@@ -0,0 +1,47 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "match.h"
+
+/* Include / exclude / highlight filter for the terminal channel, driven by a single Aho-Corasick
+ * automaton fed byte by byte across chunk boundaries.
+ *  - include: only lines containing one of the patterns are shown
+ *  - exclude: lines containing one of the patterns are dropped
+ *  - highlight: matches are wrapped in an ANSI color sequence
+ * A line is released as soon as the decision is known (first include match when there are no
+ * exclude patterns), only the undecided part of the current line is held back, and with highlight
+ * patterns the last few bytes that may still be the start of a match. */
+
+#define FILTER_PENDING_MAX 8192
+
+typedef void (*filter_sink_t)(void *ctx, const uint8_t *buf, size_t len);
+
+typedef struct
+{
+    match_t ac;
+    uint32_t include; // masks of pattern ids
+    uint32_t exclude;
+    uint32_t highlight;
+    uint32_t state;   // automaton state, carried between chunks
+    int line;         // FILTER_LINE_xxx
+    int include_hit;
+    uint8_t pending[FILTER_PENDING_MAX + 64];
+    size_t pending_len;
+    size_t floor;     // pending bytes before this are already rendered (highlight codes inserted)
+    filter_sink_t sink;
+    void *sink_ctx;
+    int active;
+} filter_t;
+
+int filter_init(filter_t *f, filter_sink_t sink, void *sink_ctx);
+int filter_add_include(filter_t *f, const char *escaped);
+int filter_add_exclude(filter_t *f, const char *escaped);
+int filter_add_highlight(filter_t *f, const char *escaped);
+int filter_build(filter_t *f);
+void filter_write(filter_t *f, const uint8_t *buf, size_t len);
+void filter_free(filter_t *f);
+
+#endif
@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "flight.h"
+#include "timebase.h"
+
+#define FLIGHT_PAGE 4096u
+
+static uint32_t flight_checksum(const flight_header_t *h)
+{
+    flight_header_t tmp = *h;
+    const uint8_t *p = (const uint8_t *)&tmp;
+    uint32_t hash = 2166136261u;
+
+    tmp.checksum = 0;
+    for (size_t i = 0; i < sizeof(tmp); i++)
+    {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int flight_slot_valid(const flight_header_t *h)
+{
+    return (strncmp(h->magic, FLIGHT_MAGIC, sizeof(h->magic)) == 0) &&
+           (h->version == FLIGHT_VERSION) &&
+           (h->checksum == flight_checksum(h)) &&
+           (h->tail <= h->head) &&
+           (h->head - h->tail <= h->size);
+}
+
+/* Pick the newest valid header slot, returns -1 if none is valid */
+static int flight_load_header(flight_recorder_t *f)
+{
+    const flight_header_t *s0 = (const flight_header_t *)f->base;
+    const flight_header_t *s1 = s0 + 1;
+    const flight_header_t *best = NULL;
+
+    if (flight_slot_valid(s0))
+        best = s0;
+    if (flight_slot_valid(s1) && ((best == NULL) || (s1->seq > best->seq)))
+        best = s1;
+    if (best == NULL)
+        return -1;
+
+    f->hdr = *best;
+    f->pub_tail = f->hdr.tail;
+    return 0;
+}
+
+static void flight_sync(flight_recorder_t *f, uint64_t phys_lo, uint64_t phys_hi, int flags)
+{
+    uintptr_t lo = (uintptr_t)(f->data + phys_lo) & ~(uintptr_t)(FLIGHT_PAGE - 1);
+    uintptr_t hi = (uintptr_t)(f->data + phys_hi);
+
+    msync((void *)lo, hi - lo, flags);
+}
+
+/* Same for the logical range [from, to) */
+static void flight_sync_range(flight_recorder_t *f, uint64_t from, uint64_t to, int flags)
+{
+    uint64_t lo = from % f->hdr.size;
+    uint64_t hi = (to - 1) % f->hdr.size + 1;
+
+    if (to <= from)
+        return;
+
+    if ((to - from >= f->hdr.size) || (lo >= hi))
+    {
+        /* wrapped (or rewrote everything), sync the whole area */
+        flight_sync(f, 0, f->hdr.size, flags);
+    }
+    else
+    {
+        flight_sync(f, lo, hi, flags);
+    }
+}
+
+/* Publish head/tail in the older header slot. The new records are handed to the kernel, durable = flush
+ * every record since the last flush and then the header to the disk */
+static int flight_publish(flight_recorder_t *f, int durable)
+{
+    int changed = (f->dirty_hi > f->dirty_lo) || (f->hdr.seq == 0) || (f->pub_tail != f->hdr.tail);
+    flight_header_t *slot;
+
+    if (!f->base)
+        return -1;
+    if (!changed && (!durable || (f->sync_seq == f->hdr.seq)))
+        return 0;
+
+    if (durable)
+        flight_sync_range(f, f->sync_lo, f->hdr.head, MS_SYNC);
+    else
+        flight_sync_range(f, f->dirty_lo, f->dirty_hi, MS_ASYNC);
+
+    if (changed)
+    {
+        f->hdr.seq++;
+        f->hdr.checksum = flight_checksum(&f->hdr);
+        slot = (flight_header_t *)f->base + (f->hdr.seq % 2);
+        *slot = f->hdr;
+        f->pub_tail = f->hdr.tail;
+        f->dirty_lo = f->dirty_hi = f->hdr.head;
+    }
+
+    if (durable)
+    {
+        msync(f->base, FLIGHT_PAGE, MS_SYNC);
+        f->sync_lo = f->hdr.head;
+        f->sync_seq = f->hdr.seq;
+        f->sync_ns = timebase_now_ns();
+    }
+    return 0;
+}
+
+/* Identifier of the current host boot, empty when the kernel doesn't tell */
+static void flight_boot_id(char *id, size_t size)
+{
+    FILE *fp = fopen("/proc/sys/kernel/random/boot_id", "r");
+
+    memset(id, 0, size);
+    if (fp == NULL)
+        return;
+    if (fgets(id, size, fp))
+        id[strcspn(id, "\n")] = 0;
+    fclose(fp);
+}
+
+/* f = recorder to initialize
+ * path = flight file, reused (keeping its history) when it already has the requested size
+ * size = size of the circular data area in bytes */
+int flight_open(flight_recorder_t *f, const char *path, uint64_t size)
+{
+    char boot_id[sizeof(f->hdr.boot_id)];
+    struct stat st;
+    int rebooted = 0;
+    int fd;
+
+    memset(f, 0, sizeof(*f));
+    size &= ~(uint64_t)(CAPTURE_ALIGN - 1);
+    if (size < 4 * FLIGHT_PAGE)
+        return -1;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return -1;
+
+    f->map_size = FLIGHT_DATA_OFFSET + size;
+    if ((fstat(fd, &st) != 0) ||
+        ((st.st_size != (off_t)f->map_size) &&
+         ((ftruncate(fd, 0) != 0) ||
+          /* as for captures, a sparse file where the blocks can't be reserved */
+          ((posix_fallocate(fd, 0, f->map_size) != 0) && (ftruncate(fd, f->map_size) != 0)))))
+    {
+        close(fd);
+        return -1;
+    }
+
+    f->base = mmap(NULL, f->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (f->base == MAP_FAILED)
+    {
+        f->base = NULL;
+        return -1;
+    }
+    f->data = f->base + FLIGHT_DATA_OFFSET;
+
+    flight_boot_id(boot_id, sizeof(boot_id));
+    if ((flight_load_header(f) != 0) || (f->hdr.size != size))
+    {
+        /* new file (or one we can't trust), start an empty history */
+        memset(f->base, 0, FLIGHT_DATA_OFFSET);
+        memset(&f->hdr, 0, sizeof(f->hdr));
+        strncpy(f->hdr.magic, FLIGHT_MAGIC, sizeof(f->hdr.magic));
+        f->hdr.version = FLIGHT_VERSION;
+        f->hdr.size = size;
+        f->hdr.start_mono_ns = timebase_now_ns();
+        f->hdr.start_real_ns = timebase_realtime_ns();
+        memcpy(f->hdr.boot_id, boot_id, sizeof(boot_id));
+        f->pub_tail = 0;
+    }
+    else if (strncmp(f->hdr.boot_id, boot_id, sizeof(boot_id)) != 0)
+    {
+        /* resumed after a reboot: the new CLOCK_MONOTONIC base is placed on the timeline of the file */
+        uint64_t now = timebase_now_ns();
+
+        f->hdr.mono_offset_ns = (int64_t)f->hdr.start_mono_ns +
+                                (int64_t)(timebase_realtime_ns() - f->hdr.start_real_ns) - (int64_t)now;
+        memcpy(f->hdr.boot_id, boot_id, sizeof(boot_id));
+        rebooted = 1;
+    }
+
+    f->dirty_lo = f->dirty_hi = f->hdr.head;
+    f->sync_lo = f->hdr.head;
+    f->active = 1;
+    if (rebooted)
+        flight_write(f, timebase_now_ns(), 0, 0, CAPTURE_REC_BOOT, (const uint8_t *)boot_id, strlen(boot_id));
+    return flight_publish(f, 1);
+}
+
+/* Drop the oldest record */
+static void flight_skip_oldest(flight_recorder_t *f)
+{
+    uint64_t p = f->hdr.tail % f->hdr.size;
+    uint64_t rem = f->hdr.size - p;
+    const capture_record_t *rec = (const capture_record_t *)(f->data + p);
+
+    if ((rem < sizeof(capture_record_t)) || (rec->type == FLIGHT_REC_WRAP) || (CAPTURE_RECORD_SIZE(rec->length) > rem))
+        f->hdr.tail += rem;
+    else
+        f->hdr.tail += CAPTURE_RECORD_SIZE(rec->length);
+
+    if (f->hdr.tail > f->hdr.head)
+        f->hdr.tail = f->hdr.head;
+}
+
+/* Make sure the writer may overwrite everything up to the logical position end. The space is taken
+ * from the oldest records and published before it is reused, with some slack so that this only
+ * happens once in a while */
+static void flight_reserve(flight_recorder_t *f, uint64_t end)
+{
+    uint64_t slack = (f->hdr.size / 4 < FLIGHT_SLACK) ? f->hdr.size / 4 : FLIGHT_SLACK;
+
+    if (end <= f->pub_tail + f->hdr.size)
+        return;
+
+    while ((f->hdr.tail < f->hdr.head) && (end + slack > f->hdr.tail + f->hdr.size))
+        flight_skip_oldest(f);
+
+    /* on the disk too before the old records are overwritten */
+    flight_publish(f, 1);
+}
+
+/* Append one framed record, it becomes part of the recovered history after the next flight_commit() */
+int flight_write(flight_recorder_t *f, uint64_t timestamp_ns, uint16_t probe, uint8_t channel, uint8_t type,
+                 const uint8_t *data, uint32_t len)
+{
+    uint64_t rs = CAPTURE_RECORD_SIZE(len);
+    uint64_t p, rem;
+    capture_record_t *rec;
+
+    if (!f->active || (rs > f->hdr.size / 4))
+        return -1;
+
+    p = f->hdr.head % f->hdr.size;
+    rem = f->hdr.size - p;
+    if (rem < rs)
+    {
+        /* the record does not fit before the end of the area, mark the rest of the lap as unused */
+        flight_reserve(f, f->hdr.head + rem);
+        if (rem >= sizeof(capture_record_t))
+        {
+            rec = (capture_record_t *)(f->data + p);
+            memset(rec, 0, sizeof(*rec));
+            rec->type = FLIGHT_REC_WRAP;
+        }
+        f->hdr.head += rem;
+        p = 0;
+    }
+
+    flight_reserve(f, f->hdr.head + rs);
+
+    rec = (capture_record_t *)(f->data + p);
+    rec->timestamp_ns = timestamp_ns + f->hdr.mono_offset_ns;
+    rec->probe = probe;
+    rec->channel = channel;
+    rec->type = type;
+    rec->length = len;
+    memcpy(rec + 1, data, len);
+    memset((uint8_t *)(rec + 1) + len, 0, rs - sizeof(*rec) - len);
+
+    f->hdr.head += rs;
+    f->dirty_hi = f->hdr.head;
+    return 0;
+}
+
+/* Publish the records written since the last commit, flushed to the disk at a bounded interval */
+int flight_commit(flight_recorder_t *f)
+{
+    int durable = (timebase_now_ns() - f->sync_ns >= FLIGHT_SYNC_MS * 1000000ull) ||
+                  (f->hdr.head - f->sync_lo >= FLIGHT_SYNC_BYTES);
+
+    return flight_publish(f, durable);
+}
+
+void flight_close(flight_recorder_t *f)
+{
+    if (!f->active)
+        return;
+
+    flight_publish(f, 1);
+    munmap(f->base, f->map_size);
+    memset(f, 0, sizeof(*f));
+}
+
+/* f = recorder descriptor to initialize read-only
+ * path = flight file, its newest valid header defines the history */
+int flight_map(flight_recorder_t *f, const char *path)
+{
+    struct stat st;
+    int fd;
+
+    memset(f, 0, sizeof(*f));
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if ((fstat(fd, &st) != 0) || (st.st_size <= FLIGHT_DATA_OFFSET))
+    {
+        close(fd);
+        return -1;
+    }
+
+    f->map_size = st.st_size;
+    f->base = mmap(NULL, f->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (f->base == MAP_FAILED)
+    {
+        f->base = NULL;
+        return -1;
+    }
+    f->data = f->base + FLIGHT_DATA_OFFSET;
+
+    if ((flight_load_header(f) != 0) || (FLIGHT_DATA_OFFSET + f->hdr.size > f->map_size))
+    {
+        flight_unmap(f);
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns the record at the logical position *pos (oldest first when *pos starts at 0) and moves
+ * *pos to the next one, NULL once the head is reached */
+const capture_record_t *flight_next(const flight_recorder_t *f, uint64_t *pos)
+{
+    if (*pos < f->hdr.tail)
+        *pos = f->hdr.tail;
+
+    while (*pos < f->hdr.head)
+    {
+        uint64_t p = *pos % f->hdr.size;
+        uint64_t rem = f->hdr.size - p;
+        const capture_record_t *rec = (const capture_record_t *)(f->data + p);
+
+        if ((rem < sizeof(capture_record_t)) || (rec->type == FLIGHT_REC_WRAP))
+        {
+            *pos += rem;
+            continue;
+        }
+
+        if (CAPTURE_RECORD_SIZE(rec->length) > rem)
+            return NULL;
+
+        *pos += CAPTURE_RECORD_SIZE(rec->length);
+        return rec;
+    }
+    return NULL;
+}
+
+void flight_unmap(flight_recorder_t *f)
+{
+    if (f->base)
+        munmap(f->base, f->map_size);
+    memset(f, 0, sizeof(*f));
+}
@@ -0,0 +1,84 @@
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "capture.h"
+
+/* Flight recorder file layout:
+ *
+ *   flight_header_t slot 0                      (offset 0)
+ *   flight_header_t slot 1                      (offset sizeof(flight_header_t))
+ *   circular data area of header.size bytes     (offset FLIGHT_DATA_OFFSET)
+ *
+ * The data area holds the same framed records as a capture file (capture_record_t + payload), records
+ * never straddle the end of the area, a FLIGHT_REC_WRAP record (or less than a record header of free
+ * space) means the rest of the lap is unused.
+ * head/tail are logical byte positions that only grow, the physical offset is position % size.
+ * The header is committed alternately into the two slots with an increasing sequence number and a
+ * checksum, a torn header write leaves the previous slot valid. The published tail is always kept
+ * FLIGHT_SLACK bytes ahead of what the writer is going to overwrite before the next commit.
+ *
+ * Every commit publishes the header in the mapping and only schedules the write back of the new records
+ * (MS_ASYNC). The records and then the header are flushed to the disk (MS_SYNC) every FLIGHT_SYNC_MS or
+ * FLIGHT_SYNC_BYTES, and before the tail moves. So after a kill -9 the history is intact up to the last
+ * commit. After a host crash or a power loss it is intact up to the last flush: the records of the last
+ * second at most may be missing, or unreadable at the end of the history when the kernel wrote the
+ * header page before their data.
+ *
+ * Record timestamps are host CLOCK_MONOTONIC, which starts again from another base after a reboot. A
+ * history resumed on another boot (boot_id changed) gets a CAPTURE_REC_BOOT record, and the records
+ * that follow are moved onto the timeline of the file with mono_offset_ns, computed from the wall clock
+ * (the payloads, e.g. the host_ns of clock samples, are not rebased). */
+
+#define FLIGHT_MAGIC "YRTTFLT"
+#define FLIGHT_VERSION 2
+#define FLIGHT_DATA_OFFSET 4096
+#define FLIGHT_SLACK (256u * 1024u)
+#define FLIGHT_REC_WRAP 0xFF
+#define FLIGHT_SYNC_MS 1000
+#define FLIGHT_SYNC_BYTES (16u * 1024u * 1024u)
+
+typedef struct
+{
+    char magic[8];          // FLIGHT_MAGIC, NUL terminated
+    uint32_t version;       // FLIGHT_VERSION
+    uint32_t checksum;      // FNV-1a of the slot with this field set to 0
+    uint64_t seq;           // incremented at every commit, the valid slot with the highest seq wins
+    uint64_t size;          // size of the data area
+    uint64_t head;          // logical position of the next record
+    uint64_t tail;          // logical position of the oldest record
+    uint64_t start_mono_ns; // same meaning as in capture_header_t
+    uint64_t start_real_ns;
+    int64_t mono_offset_ns; // added to the CLOCK_MONOTONIC timestamps of the current boot
+    char boot_id[40];       // host boot of mono_offset_ns (/proc/sys/kernel/random/boot_id), NUL terminated
+} flight_header_t;
+
+typedef struct
+{
+    uint8_t *base;     // whole file mapping
+    uint8_t *data;     // base + FLIGHT_DATA_OFFSET
+    size_t map_size;
+    flight_header_t hdr; // working copy, published by flight_commit()
+    uint64_t pub_tail; // tail of the last published header
+    uint64_t dirty_lo; // logical range written since the last commit
+    uint64_t dirty_hi;
+    uint64_t sync_lo;  // head at the last flush to the disk
+    uint64_t sync_seq; // header seq at the last flush
+    uint64_t sync_ns;
+    int active;
+} flight_recorder_t;
+
+int flight_open(flight_recorder_t *f, const char *path, uint64_t size);
+int flight_write(flight_recorder_t *f, uint64_t timestamp_ns, uint16_t probe, uint8_t channel, uint8_t type,
+                 const uint8_t *data, uint32_t len);
+int flight_commit(flight_recorder_t *f);
+void flight_close(flight_recorder_t *f);
+
+/* Reader side, works on the same structure opened read-only */
+int flight_map(flight_recorder_t *f, const char *path);
+const capture_record_t *flight_next(const flight_recorder_t *f, uint64_t *pos);
+void flight_unmap(flight_recorder_t *f);
+
+#endif
@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame.h"
+
+static uint16_t crc16_table[256];
+static uint32_t crc32_table[256];
+
+static void frame_crc_tables(void)
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint16_t c16 = i << 8;
+        uint32_t c32 = i;
+
+        for (int b = 0; b < 8; b++)
+        {
+            c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x1021 : (c16 << 1);
+            c32 = (c32 & 1) ? (c32 >> 1) ^ 0xEDB88320 : (c32 >> 1);
+        }
+        crc16_table[i] = c16;
+        crc32_table[i] = c32;
+    }
+}
+
+uint16_t frame_crc16(const uint8_t *buf, uint32_t len)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (uint32_t i = 0; i < len; i++)
+        crc = (crc << 8) ^ crc16_table[(crc >> 8) ^ buf[i]];
+    return crc;
+}
+
+uint32_t frame_crc32(const uint8_t *buf, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (uint32_t i = 0; i < len; i++)
+        crc = (crc >> 8) ^ crc32_table[(crc ^ buf[i]) & 0xFF];
+    return crc ^ 0xFFFFFFFF;
+}
+
+int frame_init(frame_t *fr, const char *spec, frame_sink_t sink, void *sink_ctx)
+{
+    char copy[64];
+    char *field, *save = NULL, *end;
+
+    memset(fr, 0, sizeof(*fr));
+    if (strlen(spec) >= sizeof(copy))
+        return -1;
+    strcpy(copy, spec);
+
+    field = strtok_r(copy, ":", &save);
+    if (field == NULL)
+        return -1;
+    fr->channel = strtol(field, &end, 0);
+    if ((*end != 0) || (fr->channel < 0))
+        return -1;
+
+    field = strtok_r(NULL, ":", &save);
+    if (field && (strcmp(field, "cobs") == 0))
+        fr->mode = FRAME_COBS;
+    else if (field && (strcmp(field, "slip") == 0))
+        fr->mode = FRAME_SLIP;
+    else
+        return -1;
+
+    while ((field = strtok_r(NULL, ":", &save)) != NULL)
+    {
+        if (strcmp(field, "crc16") == 0)
+            fr->crc = FRAME_CRC16;
+        else if (strcmp(field, "crc32") == 0)
+            fr->crc = FRAME_CRC32;
+        else if (strcmp(field, "seq") == 0)
+            fr->seq = 1;
+        else
+            return -1;
+    }
+
+    frame_crc_tables();
+    fr->sink = sink;
+    fr->sink_ctx = sink_ctx;
+    fr->active = 1;
+    return 0;
+}
+
+/* In place, the output never gets ahead of the input */
+static int frame_cobs_decode(uint8_t *p, uint32_t len, uint32_t *out_len)
+{
+    uint32_t in = 0, out = 0;
+
+    while (in < len)
+    {
+        uint8_t code = p[in++];
+
+        if ((code == 0) || (in + code - 1 > len))
+            return -1;
+        memmove(p + out, p + in, code - 1);
+        out += code - 1;
+        in += code - 1;
+        /* a full block (0xFF) has no implicit zero, neither has the last one */
+        if ((code != 0xFF) && (in < len))
+            p[out++] = 0;
+    }
+    *out_len = out;
+    return 0;
+}
+
+/* Check and strip the CRC and the sequence byte of a decoded frame */
+static void frame_deliver(frame_t *fr, uint8_t *p, uint32_t len, uint64_t ts_ns)
+{
+    uint32_t crc_len = (fr->crc == FRAME_CRC16) ? 2 : (fr->crc == FRAME_CRC32) ? 4 : 0;
+
+    if (len == 0)
+        return;
+    if (len < crc_len + (fr->seq ? 1 : 0))
+    {
+        fr->dropped++;
+        return;
+    }
+
+    len -= crc_len;
+    if (((fr->crc == FRAME_CRC16) && (frame_crc16(p, len) != (p[len] | (p[len + 1] << 8)))) ||
+        ((fr->crc == FRAME_CRC32) &&
+         (frame_crc32(p, len) != (p[len] | (p[len + 1] << 8) | (p[len + 2] << 16) | ((uint32_t)p[len + 3] << 24)))))
+    {
+        /* the sequence byte can't be trusted either, the next frame shows the gap */
+        fr->crc_errors++;
+        return;
+    }
+
+    if (fr->seq)
+    {
+        if (fr->have_seq && (p[0] != fr->next_seq))
+            fr->lost += (uint8_t)(p[0] - fr->next_seq);
+        fr->next_seq = p[0] + 1;
+        fr->have_seq = 1;
+        p++;
+        len--;
+    }
+
+    fr->frames++;
+    fr->sink(fr->sink_ctx, p, len, ts_ns);
+}
+
+/* End of an encoded frame */
+static void frame_end(frame_t *fr, uint64_t ts_ns)
+{
+    uint32_t len = fr->len;
+
+    if (fr->discard)
+        fr->dropped++;
+    else if ((fr->mode == FRAME_COBS) && (frame_cobs_decode(fr->buf, fr->len, &len) != 0))
+        fr->dropped++;
+    else
+        frame_deliver(fr, fr->buf, len, ts_ns);
+
+    fr->len = 0;
+    fr->escape = 0;
+    fr->discard = 0;
+}
+
+static void frame_put(frame_t *fr, uint8_t b)
+{
+    if (fr->len < FRAME_MAX)
+        fr->buf[fr->len++] = b;
+    else
+        fr->discard = 1;
+}
+
+void frame_write(frame_t *fr, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    uint32_t i = 0;
+
+    if (fr->mode == FRAME_COBS)
+    {
+        while (i < len)
+        {
+            const uint8_t *zero = memchr(buf + i, 0, len - i);
+            uint32_t n = (zero ? (uint32_t)(zero - buf) : len) - i;
+
+            /* the encoded bytes are copied as is, decoded once the delimiter is there */
+            if (fr->len + n <= FRAME_MAX)
+            {
+                memcpy(fr->buf + fr->len, buf + i, n);
+                fr->len += n;
+            }
+            else
+            {
+                fr->discard = 1;
+            }
+            i += n;
+
+            if (zero)
+            {
+                frame_end(fr, ts_ns);
+                i++;
+            }
+        }
+        return;
+    }
+
+    for (; i < len; i++)
+    {
+        uint8_t b = buf[i];
+
+        if (b == SLIP_END)
+        {
+            frame_end(fr, ts_ns);
+        }
+        else if (fr->escape)
+        {
+            fr->escape = 0;
+            if (b == SLIP_ESC_END)
+                frame_put(fr, SLIP_END);
+            else if (b == SLIP_ESC_ESC)
+                frame_put(fr, SLIP_ESC);
+            else
+                fr->discard = 1;
+        }
+        else if (b == SLIP_ESC)
+        {
+            fr->escape = 1;
+        }
+        else
+        {
+            frame_put(fr, b);
+        }
+    }
+}
+
+void frame_reset(frame_t *fr)
+{
+    fr->len = 0;
+    fr->escape = 0;
+    fr->discard = 0;
+    fr->have_seq = 0;
+}
@@ -0,0 +1,63 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Framing layer for binary up channels: the byte stream is split into COBS (0x00 delimited) or SLIP
+ * (RFC 1055, 0xC0 delimited) frames, incrementally so a frame can be split between any two polls.
+ * Optionally every frame ends with a CRC of the rest of the frame, little endian:
+ *   crc16   CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), 2 bytes
+ *   crc32   CRC-32 as zlib (poly 0xEDB88320 reflected, init and xorout 0xFFFFFFFF), 4 bytes
+ * and/or starts with a sequence byte incremented by one on every frame, used to count the lost ones.
+ * Valid frames go to the sink without the sequence byte and the CRC, empty frames are ignored. */
+
+#define FRAME_COBS 0
+#define FRAME_SLIP 1
+
+#define FRAME_CRC_NONE 0
+#define FRAME_CRC16 1
+#define FRAME_CRC32 2
+
+#define FRAME_MAX 4096 /* longest encoded frame, longer ones are dropped */
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+typedef void (*frame_sink_t)(void *ctx, const uint8_t *buf, uint32_t len, uint64_t ts_ns);
+
+typedef struct
+{
+    int channel;
+    int mode; // FRAME_COBS, FRAME_SLIP
+    int crc;  // FRAME_CRC_xxx
+    int seq;  // frames start with a sequence byte
+    /* frame being received, carried between reads */
+    uint8_t buf[FRAME_MAX];
+    uint32_t len;
+    int escape;  // SLIP escape byte seen
+    int discard; // the current frame is broken, skipped up to the next delimiter
+    int have_seq;
+    uint8_t next_seq;
+    frame_sink_t sink;
+    void *sink_ctx;
+    uint64_t frames;
+    uint64_t crc_errors;
+    uint64_t lost;    // frames missing from the sequence
+    uint64_t dropped; // malformed or too long
+    int active;
+} frame_t;
+
+/* spec = "CH:cobs|slip[:crc16|crc32][:seq]", e.g. "1:cobs:crc16:seq" */
+int frame_init(frame_t *fr, const char *spec, frame_sink_t sink, void *sink_ctx);
+/* Split the channel data received at host time ts_ns, complete frames go to the sink */
+void frame_write(frame_t *fr, const uint8_t *buf, uint32_t len, uint64_t ts_ns);
+/* The stream restarted (target reset), drop the partial frame and the sequence */
+void frame_reset(frame_t *fr);
+
+uint16_t frame_crc16(const uint8_t *buf, uint32_t len);
+uint32_t frame_crc32(const uint8_t *buf, uint32_t len);
+
+#endif
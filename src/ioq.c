@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ioq.h"
+
+/* GCC atomics, the tree is C99 */
+#define IOQ_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define IOQ_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/* Time between two checks of a full ring or of a sync */
+#define IOQ_WAIT_US 100
+
+static void *ioq_worker(void *arg)
+{
+    ioq_t *q = arg;
+    uint64_t tail = q->tail;
+    int dirty = 0;
+
+    while (1)
+    {
+        uint64_t head = IOQ_LOAD(&q->head);
+
+        if (tail == head)
+        {
+            if (dirty)
+            {
+                q->idle(q->ctx);
+                dirty = 0;
+            }
+            IOQ_STORE(&q->synced, head);
+            if (!q->running)
+                break;
+            sem_wait(&q->wake);
+            continue;
+        }
+
+        uint64_t pos = tail % q->size;
+        const ioq_rec_t *rec = (const ioq_rec_t *)(q->buf + pos);
+
+        /* too little room left for a header, or a wrap record: the next one is at the start */
+        if ((q->size - pos < sizeof(ioq_rec_t)) || (rec->type == IOQ_REC_WRAP))
+        {
+            tail += q->size - pos;
+        }
+        else
+        {
+            q->handler(q->ctx, rec, (const uint8_t *)(rec + 1));
+            tail += IOQ_REC_SIZE(rec->len);
+            dirty = 1;
+        }
+        IOQ_STORE(&q->tail, tail);
+    }
+    return NULL;
+}
+
+int ioq_init(ioq_t *q, uint64_t size, ioq_handler_t handler, ioq_idle_t idle, void *ctx)
+{
+    memset(q, 0, sizeof(*q));
+    if (size < IOQ_MIN_SIZE)
+        size = IOQ_MIN_SIZE;
+    q->size = size & ~(uint64_t)(IOQ_ALIGN - 1);
+    q->buf = malloc(q->size);
+    if (q->buf == NULL)
+        return -1;
+
+    q->handler = handler;
+    q->idle = idle;
+    q->ctx = ctx;
+    q->running = 1;
+    sem_init(&q->wake, 0, 0);
+    if (pthread_create(&q->thread, NULL, ioq_worker, q) != 0)
+    {
+        sem_destroy(&q->wake);
+        free(q->buf);
+        q->buf = NULL;
+        return -1;
+    }
+    q->active = 1;
+    return 0;
+}
+
+/* Wait until the worker released enough of the ring, returns the position to write at */
+static uint64_t ioq_reserve(ioq_t *q, uint64_t need)
+{
+    int stalled = 0;
+
+    while (q->size - (q->head - IOQ_LOAD(&q->tail)) < need)
+    {
+        stalled = 1;
+        sem_post(&q->wake);
+        usleep(IOQ_WAIT_US);
+    }
+    if (stalled)
+        q->stalls++;
+    return q->head % q->size;
+}
+
+void ioq_push(ioq_t *q, uint8_t type, uint16_t channel, uint64_t ts_ns, uint32_t avail, const uint8_t *data,
+              uint32_t len)
+{
+    uint64_t rec_size = IOQ_REC_SIZE(len);
+    uint64_t pos = q->head % q->size;
+    uint64_t skip = 0;
+    ioq_rec_t *rec;
+
+    /* records never wrap, the end of the ring is skipped when it is too small */
+    if (q->size - pos < rec_size)
+        skip = q->size - pos;
+
+    pos = ioq_reserve(q, skip + rec_size);
+    if (skip > 0)
+    {
+        if (skip >= sizeof(ioq_rec_t))
+            ((ioq_rec_t *)(q->buf + pos))->type = IOQ_REC_WRAP;
+        /* the worker may read the wrap record as soon as head moves past it */
+        IOQ_STORE(&q->head, q->head + skip);
+        pos = 0;
+    }
+
+    rec = (ioq_rec_t *)(q->buf + pos);
+    rec->ts_ns = ts_ns;
+    rec->len = len;
+    rec->avail = avail;
+    rec->channel = channel;
+    rec->type = type;
+    if (len > 0)
+        memcpy(rec + 1, data, len);
+
+    IOQ_STORE(&q->head, q->head + rec_size);
+    if (q->head - IOQ_LOAD(&q->tail) > q->max_used)
+        q->max_used = q->head - IOQ_LOAD(&q->tail);
+    q->records++;
+    sem_post(&q->wake);
+}
+
+void ioq_sync(ioq_t *q)
+{
+    if (!q->active)
+        return;
+
+    while (IOQ_LOAD(&q->synced) != q->head)
+    {
+        sem_post(&q->wake);
+        usleep(IOQ_WAIT_US);
+    }
+}
+
+void ioq_stop(ioq_t *q)
+{
+    if (!q->active)
+        return;
+
+    ioq_sync(q);
+    q->running = 0;
+    sem_post(&q->wake);
+    pthread_join(q->thread, NULL);
+    sem_destroy(&q->wake);
+    free(q->buf);
+    q->buf = NULL;
+    q->active = 0;
+}
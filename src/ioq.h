@@ -0,0 +1,67 @@
+#ifndef IOQ_H
+#define IOQ_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+/* Output queue between the probe thread and an output worker thread: a lock-free single producer /
+ * single consumer ring of variable size records (header + payload padded to 8 bytes), so the sinks
+ * (terminal, files, sockets, decoders) never delay the next poll. The producer only waits when the ring
+ * is full, the data has already been released on the target and can't be dropped.
+ * The worker calls the handler for every record in order, then the idle callback once the ring is empty
+ * (to commit what the sinks buffered) before sleeping. */
+
+#define IOQ_ALIGN 8
+#define IOQ_MIN_SIZE (1024u * 1024u)
+
+/* ioq_rec_t.type, the values below IOQ_REC_WRAP belong to the user */
+#define IOQ_REC_WRAP 0xFF /* the rest of the ring is unused, the next record is at the start */
+
+typedef struct
+{
+    uint64_t ts_ns;
+    uint32_t len;   // payload length
+    uint32_t avail; // free for the user (e.g. bytes waiting in the channel)
+    uint16_t channel;
+    uint8_t type;
+    uint8_t reserved[5];
+} ioq_rec_t;
+
+#define IOQ_REC_SIZE(len) (sizeof(ioq_rec_t) + (((len) + IOQ_ALIGN - 1) & ~(uint64_t)(IOQ_ALIGN - 1)))
+
+typedef void (*ioq_handler_t)(void *ctx, const ioq_rec_t *rec, const uint8_t *payload);
+typedef void (*ioq_idle_t)(void *ctx);
+
+typedef struct
+{
+    uint8_t *buf;
+    uint64_t size;
+    /* free running byte counters, position = counter % size */
+    uint64_t head;   // published by the producer
+    uint64_t tail;   // released by the worker once a record is handled
+    uint64_t synced; // head value the worker has fully handled and committed
+    sem_t wake;
+    pthread_t thread;
+    volatile int running;
+    ioq_handler_t handler;
+    ioq_idle_t idle;
+    void *ctx;
+    uint64_t records;
+    uint64_t stalls;   // pushes that had to wait for room
+    uint64_t max_used; // highest fill seen by the producer
+    int active;
+} ioq_t;
+
+/* size = ring size in bytes (at least IOQ_MIN_SIZE), starts the worker thread */
+int ioq_init(ioq_t *q, uint64_t size, ioq_handler_t handler, ioq_idle_t idle, void *ctx);
+/* Producer side: queue one record, waits while the ring is full */
+void ioq_push(ioq_t *q, uint8_t type, uint16_t channel, uint64_t ts_ns, uint32_t avail, const uint8_t *data,
+              uint32_t len);
+/* Producer side: wait until everything queued has been handled and committed, the sinks can then be
+ * touched by the producer until the next push */
+void ioq_sync(ioq_t *q);
+/* Sync, then stop the worker and free the ring */
+void ioq_stop(ioq_t *q);
+
+#endif
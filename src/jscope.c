@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jscope.h"
+#include "timebase.h"
+
+static const char *jscope_format(const char *channel_name)
+{
+    if (strncmp(channel_name, JSCOPE_PREFIX, strlen(JSCOPE_PREFIX)) == 0)
+        return channel_name + strlen(JSCOPE_PREFIX);
+    if (strncmp(channel_name, JSCOPE_PREFIX_ALT, strlen(JSCOPE_PREFIX_ALT)) == 0)
+        return channel_name + strlen(JSCOPE_PREFIX_ALT);
+    return NULL;
+}
+
+int jscope_match(const char *channel_name)
+{
+    return jscope_format(channel_name) != NULL;
+}
+
+static int jscope_parse(jscope_t *js, const char *fmt)
+{
+    while (*fmt)
+    {
+        char kind = *fmt++;
+        int size;
+
+        if (*fmt == 0)
+            return -1;
+        size = *fmt++ - '0';
+
+        if ((js->cols >= JSCOPE_MAX_COLUMNS) || (strchr("tbiuf", kind) == NULL) ||
+            ((size != 1) && (size != 2) && (size != 4)) || ((kind == 't') && (size != 4)) ||
+            ((kind == 'f') && (size != 4)))
+            return -1;
+
+        js->col[js->cols].kind = kind;
+        js->col[js->cols].size = size;
+        js->cols++;
+        js->record_size += size;
+    }
+    return (js->cols > 0) ? 0 : -1;
+}
+
+int jscope_open(jscope_t *js, const char *channel_name, const char *path)
+{
+    const char *fmt = jscope_format(channel_name);
+    size_t len = strlen(path);
+
+    memset(js, 0, sizeof(*js));
+    if ((fmt == NULL) || (jscope_parse(js, fmt) != 0))
+        return -1;
+
+    if ((len > 4) && (strcmp(path + len - 4, ".csv") == 0))
+    {
+        js->csv = fopen(path, "w");
+        if (js->csv == NULL)
+            return -1;
+
+        fprintf(js->csv, "host_s");
+        for (int i = 0; i < js->cols; i++)
+            fprintf(js->csv, ",%c%u_%d", js->col[i].kind, js->col[i].size, i);
+        fprintf(js->csv, "\n");
+    }
+    else
+    {
+        for (int i = 0; i < js->cols; i++)
+        {
+            char *name;
+
+            if (asprintf(&name, "%s.%d.%c%u", path, i, js->col[i].kind, js->col[i].size) < 0)
+                return -1;
+            js->col[i].f = fopen(name, "wb");
+            free(name);
+            if (js->col[i].f == NULL)
+            {
+                jscope_close(js);
+                return -1;
+            }
+        }
+    }
+
+    js->start_ns = timebase_now_ns();
+    js->active = 1;
+    return 0;
+}
+
+static void jscope_csv_value(FILE *f, const jscope_column_t *c, const uint8_t *p)
+{
+    uint32_t u = p[0];
+    float fl;
+
+    if (c->size >= 2)
+        u |= p[1] << 8;
+    if (c->size == 4)
+        u |= (p[2] << 16) | ((uint32_t)p[3] << 24);
+
+    switch (c->kind)
+    {
+    case 'i':
+        if (c->size == 1)
+            fprintf(f, ",%d", (int8_t)u);
+        else if (c->size == 2)
+            fprintf(f, ",%d", (int16_t)u);
+        else
+            fprintf(f, ",%d", (int32_t)u);
+        break;
+    case 'f':
+        memcpy(&fl, &u, sizeof(fl));
+        fprintf(f, ",%.9g", fl);
+        break;
+    default:
+        fprintf(f, ",%u", u);
+        break;
+    }
+}
+
+static void jscope_record(jscope_t *js, const uint8_t *rec, uint64_t ts_ns)
+{
+    if (js->csv)
+    {
+        fprintf(js->csv, "%.6f", (ts_ns - js->start_ns) / 1e9);
+        for (int i = 0; i < js->cols; i++)
+        {
+            jscope_csv_value(js->csv, &js->col[i], rec);
+            rec += js->col[i].size;
+        }
+        fprintf(js->csv, "\n");
+    }
+    else
+    {
+        for (int i = 0; i < js->cols; i++)
+        {
+            fwrite(rec, js->col[i].size, 1, js->col[i].f);
+            rec += js->col[i].size;
+        }
+    }
+    js->records++;
+}
+
+void jscope_feed(jscope_t *js, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    if (!js->active)
+        return;
+
+    /* complete the record started in the previous read */
+    if (js->partial_len > 0)
+    {
+        uint32_t n = js->record_size - js->partial_len;
+
+        if (n > len)
+            n = len;
+        memcpy(js->partial + js->partial_len, buf, n);
+        js->partial_len += n;
+        buf += n;
+        len -= n;
+        if (js->partial_len < js->record_size)
+            return;
+        jscope_record(js, js->partial, ts_ns);
+        js->partial_len = 0;
+    }
+
+    while (len >= js->record_size)
+    {
+        jscope_record(js, buf, ts_ns);
+        buf += js->record_size;
+        len -= js->record_size;
+    }
+
+    memcpy(js->partial, buf, len);
+    js->partial_len = len;
+}
+
+void jscope_resync(jscope_t *js)
+{
+    js->partial_len = 0;
+}
+
+void jscope_close(jscope_t *js)
+{
+    if (js->csv)
+        fclose(js->csv);
+    js->csv = NULL;
+    for (int i = 0; i < js->cols; i++)
+    {
+        if (js->col[i].f)
+            fclose(js->col[i].f);
+        js->col[i].f = NULL;
+    }
+    js->active = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef JSCOPE_H
+#define JSCOPE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Decoder for the J-Scope RTT protocol: an up channel named "JScope_<format>" carries fixed size
+ * little endian records, the format lists the fields, a type letter followed by the size in bytes:
+ *   t4      timestamp, microseconds (uint32)
+ *   b1      bool
+ *   i1 i2 i4  signed integers
+ *   u1 u2 u4  unsigned integers
+ *   f4      float
+ * e.g. "JScope_t4i4u2". The records are written as CSV (output ending in .csv) or as one flat array
+ * file per column, <prefix>.<n>.<field> (e.g. scope.1.i4), ready for numpy.fromfile() and the like. */
+
+#define JSCOPE_PREFIX "JScope_"
+#define JSCOPE_PREFIX_ALT "J-Scope_"
+#define JSCOPE_MAX_COLUMNS 32
+#define JSCOPE_MAX_RECORD (JSCOPE_MAX_COLUMNS * 4)
+
+typedef struct
+{
+    char kind; // t b i u f
+    uint8_t size;
+    FILE *f; // columnar output
+} jscope_column_t;
+
+typedef struct
+{
+    jscope_column_t col[JSCOPE_MAX_COLUMNS];
+    int cols;
+    uint32_t record_size;
+    uint8_t partial[JSCOPE_MAX_RECORD]; // record split between two reads
+    uint32_t partial_len;
+    FILE *csv;
+    uint64_t start_ns;
+    uint64_t records;
+    int active;
+} jscope_t;
+
+/* 1 if the channel name announces a J-Scope stream */
+int jscope_match(const char *channel_name);
+/* channel_name = name of the up channel, path = CSV file or columnar files prefix */
+int jscope_open(jscope_t *js, const char *channel_name, const char *path);
+/* Decode the data of the channel, received at host time ts_ns */
+void jscope_feed(jscope_t *js, const uint8_t *buf, uint32_t len, uint64_t ts_ns);
+/* The stream restarted (target reset), drop the partial record */
+void jscope_resync(jscope_t *js);
+void jscope_close(jscope_t *js);
+
+#endif
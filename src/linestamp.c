@@ -0,0 +1,100 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "linestamp.h"
+#include "timebase.h"
+
+/* First '\n' in [p, end), NULL if none. 16 bytes are compared at once where SSE2 is available */
+static const uint8_t *find_newline(const uint8_t *p, const uint8_t *end)
+{
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+
+    while (end - p >= 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), nl));
+
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    return (p < end) ? memchr(p, '\n', end - p) : NULL;
+}
+
+static void linestamp_prefix(linestamp_t *ls, uint64_t t_ns)
+{
+    char prefix[48];
+    int n;
+
+    if (ls->mode == LINESTAMP_WALL)
+    {
+        uint64_t real = ls->start_real_ns + (t_ns - ls->start_mono_ns);
+        time_t sec = real / 1000000000ull;
+        struct tm tm;
+
+        localtime_r(&sec, &tm);
+        n = snprintf(prefix, sizeof(prefix), "[%02d:%02d:%02d.%06u] ", tm.tm_hour, tm.tm_min, tm.tm_sec,
+                     (unsigned)((real % 1000000000ull) / 1000));
+    }
+    else
+    {
+        uint64_t rel = t_ns - ls->start_mono_ns;
+
+        n = snprintf(prefix, sizeof(prefix), "[%6u.%06u] ", (unsigned)(rel / 1000000000ull),
+                     (unsigned)((rel % 1000000000ull) / 1000));
+    }
+    ls->sink(ls->sink_ctx, (const uint8_t *)prefix, n);
+}
+
+/* ls = line stamper to initialize
+ * mode = LINESTAMP_xxx
+ * sink = where the stamped stream goes */
+void linestamp_init(linestamp_t *ls, int mode, linestamp_sink_t sink, void *sink_ctx)
+{
+    memset(ls, 0, sizeof(*ls));
+    ls->mode = mode;
+    ls->at_line_start = 1;
+    ls->start_mono_ns = timebase_now_ns();
+    ls->start_real_ns = timebase_realtime_ns();
+    ls->sink = sink;
+    ls->sink_ctx = sink_ctx;
+    ls->active = 1;
+}
+
+void linestamp_write(linestamp_t *ls, const uint8_t *buf, size_t len, uint32_t avail, uint64_t poll_ns)
+{
+    const uint8_t *p = buf, *end = buf + len;
+    uint64_t t0 = ls->prev_poll_ns ? ls->prev_poll_ns : poll_ns;
+    uint32_t old = (ls->backlog < avail) ? ls->backlog : avail;
+    uint32_t fresh = avail - old; // bytes written by the target since the previous poll
+
+    while (p < end)
+    {
+        const uint8_t *nl = find_newline(p, end);
+        const uint8_t *stop = nl ? nl + 1 : end;
+
+        if (ls->at_line_start)
+        {
+            uint32_t idx = p - buf;
+            uint64_t t = t0;
+
+            if ((idx >= old) && (fresh > 0))
+                t = t0 + (poll_ns - t0) * (idx - old + 1) / fresh;
+            linestamp_prefix(ls, t);
+        }
+
+        ls->sink(ls->sink_ctx, p, stop - p);
+        ls->at_line_start = (nl != NULL);
+        p = stop;
+    }
+
+    ls->backlog = avail - len;
+    ls->prev_poll_ns = poll_ns;
+}
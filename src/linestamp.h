@@ -0,0 +1,38 @@
+#ifndef LINESTAMP_H
+#define LINESTAMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Prefix every line of the terminal channel with its host receive time.
+ * The target writes between two polls are assumed to be evenly spread over the poll interval, so the
+ * time of each byte is interpolated from its position in the bytes that appeared since the previous
+ * poll (WrOff progress), bytes that were already waiting at the previous poll get that poll's time.
+ * The chunk is passed to the sink in place, only the "at line start" flag is carried to the next
+ * chunk, a partial line is never copied. */
+
+#define LINESTAMP_REL 0  /* seconds since start */
+#define LINESTAMP_WALL 1 /* local wall clock */
+
+typedef void (*linestamp_sink_t)(void *ctx, const uint8_t *buf, size_t len);
+
+typedef struct
+{
+    int mode;
+    int at_line_start;
+    uint64_t start_mono_ns;
+    uint64_t start_real_ns;
+    uint64_t prev_poll_ns; // time of the previous poll, 0 before the first one
+    uint32_t backlog;      // bytes already available at the previous poll and not drained yet
+    linestamp_sink_t sink;
+    void *sink_ctx;
+    int active;
+} linestamp_t;
+
+void linestamp_init(linestamp_t *ls, int mode, linestamp_sink_t sink, void *sink_ctx);
+/* buf, len = drained bytes
+ * avail = bytes that were available in the target buffer when it was drained (>= len)
+ * poll_ns = host time of the poll */
+void linestamp_write(linestamp_t *ls, const uint8_t *buf, size_t len, uint32_t avail, uint64_t poll_ns);
+
+#endif
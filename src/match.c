@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "match.h"
+
+#define MATCH_NONE 0xFFFFFFFFu
+
+static int match_grow(match_t *m)
+{
+    uint32_t cap = m->capacity ? m->capacity * 2 : 64;
+    uint32_t *next = realloc(m->next, (size_t)cap * 256 * sizeof(uint32_t));
+    uint32_t *out;
+    uint16_t *depth;
+
+    if (next == NULL)
+        return -1;
+    m->next = next;
+
+    out = realloc(m->out, cap * sizeof(uint32_t));
+    if (out == NULL)
+        return -1;
+    m->out = out;
+
+    depth = realloc(m->depth, cap * sizeof(uint16_t));
+    if (depth == NULL)
+        return -1;
+    m->depth = depth;
+
+    memset(m->next + (size_t)m->capacity * 256, 0xFF, (size_t)(cap - m->capacity) * 256 * sizeof(uint32_t));
+    m->capacity = cap;
+    return 0;
+}
+
+/* m = matcher to initialize, with only the root state */
+int match_init(match_t *m)
+{
+    memset(m, 0, sizeof(*m));
+    if (match_grow(m) != 0)
+    {
+        match_free(m);
+        return -1;
+    }
+
+    m->states = 1;
+    m->out[0] = 0;
+    m->depth[0] = 0;
+    return 0;
+}
+
+/* Patterns can only be added before match_build() */
+int match_add(match_t *m, const uint8_t *pattern, uint32_t len)
+{
+    uint32_t s = 0;
+
+    if ((len == 0) || (len > UINT16_MAX) || (m->count >= MATCH_MAX_PATTERNS))
+        return -1;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        if (m->next[s * 256 + pattern[i]] == MATCH_NONE)
+        {
+            if ((m->states == m->capacity) && (match_grow(m) != 0))
+                return -1;
+
+            m->out[m->states] = 0;
+            m->depth[m->states] = i + 1;
+            m->next[s * 256 + pattern[i]] = m->states++;
+        }
+        s = m->next[s * 256 + pattern[i]];
+    }
+
+    m->out[s] |= 1u << m->count;
+    m->len[m->count] = len;
+    return m->count++;
+}
+
+/* Turn the trie into a DFA: every missing transition follows the failure link, and every state also
+ * reports the patterns that end at its failure states */
+int match_build(match_t *m)
+{
+    uint32_t *fail = malloc(m->states * sizeof(uint32_t));
+    uint32_t *queue = malloc(m->states * sizeof(uint32_t));
+    uint32_t head = 0, tail = 0;
+
+    if ((fail == NULL) || (queue == NULL))
+    {
+        free(fail);
+        free(queue);
+        return -1;
+    }
+
+    for (int c = 0; c < 256; c++)
+    {
+        uint32_t t = m->next[c];
+
+        if (t == MATCH_NONE)
+        {
+            m->next[c] = 0;
+        }
+        else
+        {
+            fail[t] = 0;
+            queue[tail++] = t;
+        }
+    }
+
+    while (head < tail)
+    {
+        uint32_t s = queue[head++];
+
+        m->out[s] |= m->out[fail[s]];
+        for (int c = 0; c < 256; c++)
+        {
+            uint32_t t = m->next[s * 256 + c];
+
+            if (t == MATCH_NONE)
+            {
+                m->next[s * 256 + c] = m->next[fail[s] * 256 + c];
+            }
+            else
+            {
+                fail[t] = m->next[fail[s] * 256 + c];
+                queue[tail++] = t;
+            }
+        }
+    }
+
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+void match_free(match_t *m)
+{
+    free(m->next);
+    free(m->out);
+    free(m->depth);
+    memset(m, 0, sizeof(*m));
+}
+
+long match_feed(const match_t *m, uint32_t *state, const uint8_t *buf, size_t len, uint32_t *hit)
+{
+    uint32_t s = *state;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        s = match_step(m, s, buf[i]);
+        if (m->out[s])
+        {
+            *state = s;
+            *hit = m->out[s];
+            return (long)(i + 1);
+        }
+    }
+
+    *state = s;
+    return -1;
+}
+
+static int hex_value(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+        return c - '0';
+    if ((c >= 'a') && (c <= 'f'))
+        return c - 'a' + 10;
+    if ((c >= 'A') && (c <= 'F'))
+        return c - 'A' + 10;
+    return -1;
+}
+
+uint32_t match_unescape(const char *in, uint8_t *out)
+{
+    uint32_t n = 0;
+
+    while (*in)
+    {
+        if ((*in != '\\') || (in[1] == '\0'))
+        {
+            out[n++] = (uint8_t)*in++;
+            continue;
+        }
+
+        in++;
+        switch (*in)
+        {
+        case 'n':
+            out[n++] = '\n';
+            break;
+        case 'r':
+            out[n++] = '\r';
+            break;
+        case 't':
+            out[n++] = '\t';
+            break;
+        case '0':
+            out[n++] = '\0';
+            break;
+        case 'x':
+            if ((hex_value(in[1]) >= 0) && (hex_value(in[2]) >= 0))
+            {
+                out[n++] = (uint8_t)(hex_value(in[1]) * 16 + hex_value(in[2]));
+                in += 2;
+            }
+            else
+            {
+                out[n++] = 'x';
+            }
+            break;
+        default:
+            out[n++] = (uint8_t)*in;
+            break;
+        }
+        in++;
+    }
+    return n;
+}
@@ -0,0 +1,43 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Streaming multi-pattern matcher (Aho-Corasick compiled into a DFA). The only per-stream state is
+ * the current DFA state, so a pattern split across two drained chunks is still found without
+ * buffering anything */
+
+#define MATCH_MAX_PATTERNS 32
+
+typedef struct
+{
+    uint32_t *next;  // states * 256 transitions
+    uint32_t *out;   // per state, mask of the patterns ending there (suffixes included)
+    uint16_t *depth; // per state, length of the prefix it represents
+    uint32_t states;
+    uint32_t capacity;
+    uint32_t count;  // number of patterns
+    uint16_t len[MATCH_MAX_PATTERNS];
+} match_t;
+
+int match_init(match_t *m);
+/* Returns the id of the new pattern (bit id in the output masks) or -1 */
+int match_add(match_t *m, const uint8_t *pattern, uint32_t len);
+int match_build(match_t *m);
+void match_free(match_t *m);
+
+static inline uint32_t match_step(const match_t *m, uint32_t state, uint8_t c)
+{
+    return m->next[state * 256 + c];
+}
+
+/* Returns the offset in buf right after the first match (its pattern mask in *hit), or -1,
+ * *state is updated either way */
+long match_feed(const match_t *m, uint32_t *state, const uint8_t *buf, size_t len, uint32_t *hit);
+
+/* Decode C style escapes (\n, \r, \t, \0, \\, \xHH) from a command line argument,
+ * out must be at least strlen(in) bytes, returns the decoded length */
+uint32_t match_unescape(const char *in, uint8_t *out);
+
+#endif
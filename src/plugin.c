@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "plugin.h"
+#include "status.h"
+
+static int plugin_subscribe(yrtt_host_t *host, int channel, const yrtt_handler_t *handler)
+{
+    plugin_host_t *ph = (plugin_host_t *)host;
+    plugin_handler_t *slot;
+
+    if ((ph->handlers >= PLUGIN_MAX_HANDLERS) || (handler == NULL) ||
+        (handler->size < offsetof(yrtt_handler_t, restart)) || (handler->data == NULL) || (channel < YRTT_ALL_CHANNELS))
+        return -1;
+
+    /* an older plugin may know fewer fields, the missing ones stay zero */
+    slot = &ph->handler[ph->handlers++];
+    memset(slot, 0, sizeof(*slot));
+    memcpy(&slot->h, handler, (handler->size < sizeof(yrtt_handler_t)) ? handler->size : sizeof(yrtt_handler_t));
+    slot->h.size = sizeof(yrtt_handler_t);
+    slot->channel = channel;
+    ph->flags |= slot->h.flags;
+    return 0;
+}
+
+static void plugin_log(yrtt_host_t *host, const char *msg)
+{
+    plugin_host_t *ph = (plugin_host_t *)host;
+
+    status_info("[%s] %s", ph->loading ? ph->loading : "plugin", msg);
+}
+
+void plugin_init(plugin_host_t *ph)
+{
+    memset(ph, 0, sizeof(*ph));
+    ph->host.abi = YRTT_PLUGIN_ABI;
+    ph->host.size = sizeof(yrtt_host_t);
+    ph->host.subscribe = plugin_subscribe;
+    ph->host.log = plugin_log;
+}
+
+int plugin_load(plugin_host_t *ph, const char *spec)
+{
+    char path[4096];
+    const char *args = strchr(spec, ',');
+    size_t len = args ? (size_t)(args - spec) : strlen(spec);
+    yrtt_plugin_init_t init;
+    void *lib;
+    int handlers = ph->handlers;
+
+    if ((ph->libs >= PLUGIN_MAX) || (len >= sizeof(path)))
+        return -1;
+    memcpy(path, spec, len);
+    path[len] = 0;
+
+    lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL)
+    {
+        printf("%s\n", dlerror());
+        return -1;
+    }
+
+    init = (yrtt_plugin_init_t)dlsym(lib, "yrtt_plugin_init");
+    ph->loading = path;
+    if ((init == NULL) || (init(&ph->host, args ? args + 1 : "") != 0))
+    {
+        /* the handlers it registered before failing point into the library */
+        ph->handlers = handlers;
+        ph->flags = 0;
+        for (int i = 0; i < ph->handlers; i++)
+            ph->flags |= ph->handler[i].h.flags;
+        ph->loading = NULL;
+        dlclose(lib);
+        return -1;
+    }
+    ph->loading = NULL;
+
+    ph->lib[ph->libs++] = lib;
+    ph->active = 1;
+    return 0;
+}
+
+int plugin_wants(const plugin_host_t *ph, int channel)
+{
+    if (!(ph->flags & YRTT_DATA))
+        return 0;
+
+    for (int i = 0; i < ph->handlers; i++)
+    {
+        const plugin_handler_t *s = &ph->handler[i];
+
+        if ((s->h.flags & YRTT_DATA) && ((s->channel == channel) || (s->channel == YRTT_ALL_CHANNELS)))
+            return 1;
+    }
+    return 0;
+}
+
+/* 1 if the handler is called from the worker pool */
+static int plugin_in_pool(const plugin_host_t *ph, const plugin_handler_t *s)
+{
+    return ph->pooled && (s->h.flags & YRTT_PARALLEL);
+}
+
+static void plugin_dispatch(plugin_host_t *ph, uint32_t flag, int pooled, int channel, const uint8_t *buf,
+                            uint32_t len, uint64_t ts_ns)
+{
+    yrtt_span_t span = {buf, len};
+
+    if (!(ph->flags & flag))
+        return;
+
+    for (int i = 0; i < ph->handlers; i++)
+    {
+        plugin_handler_t *s = &ph->handler[i];
+
+        if ((s->h.flags & flag) && ((s->channel == channel) || (s->channel == YRTT_ALL_CHANNELS)) &&
+            (plugin_in_pool(ph, s) == pooled))
+            s->h.data(s->h.user, channel, &span, 1, ts_ns);
+    }
+}
+
+int plugin_pooled(const plugin_host_t *ph, uint32_t flag, int channel)
+{
+    if (!ph->pooled || !(ph->flags & flag) || !(ph->flags & YRTT_PARALLEL))
+        return 0;
+
+    for (int i = 0; i < ph->handlers; i++)
+    {
+        const plugin_handler_t *s = &ph->handler[i];
+
+        if ((s->h.flags & flag) && ((s->channel == channel) || (s->channel == YRTT_ALL_CHANNELS)) &&
+            plugin_in_pool(ph, s))
+            return 1;
+    }
+    return 0;
+}
+
+void plugin_data(plugin_host_t *ph, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    plugin_dispatch(ph, YRTT_DATA, 0, channel, buf, len, ts_ns);
+}
+
+void plugin_pooled_data(plugin_host_t *ph, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    plugin_dispatch(ph, YRTT_DATA, 1, channel, buf, len, ts_ns);
+}
+
+void plugin_frame(plugin_host_t *ph, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    plugin_dispatch(ph, YRTT_FRAMES, 0, channel, buf, len, ts_ns);
+}
+
+void plugin_pooled_frame(plugin_host_t *ph, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    plugin_dispatch(ph, YRTT_FRAMES, 1, channel, buf, len, ts_ns);
+}
+
+void plugin_restart(plugin_host_t *ph)
+{
+    for (int i = 0; i < ph->handlers; i++)
+    {
+        plugin_handler_t *s = &ph->handler[i];
+
+        if (s->h.restart)
+            s->h.restart(s->h.user, s->channel);
+    }
+}
+
+void plugin_unload(plugin_host_t *ph)
+{
+    for (int i = ph->libs - 1; i >= 0; i--)
+    {
+        yrtt_plugin_exit_t fini = (yrtt_plugin_exit_t)dlsym(ph->lib[i], "yrtt_plugin_exit");
+
+        if (fini)
+            fini();
+        dlclose(ph->lib[i]);
+    }
+    ph->libs = 0;
+    ph->handlers = 0;
+    ph->flags = 0;
+    ph->active = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <stdint.h>
+
+#include "yastrtt_plugin.h"
+
+/* Host side of the plugin ABI (yastrtt_plugin.h): loads the decoders and dispatches the drained data
+ * and the frames to the handlers they subscribed. */
+
+#define PLUGIN_MAX 16
+#define PLUGIN_MAX_HANDLERS 64
+
+typedef struct
+{
+    int channel;
+    yrtt_handler_t h;
+} plugin_handler_t;
+
+typedef struct
+{
+    yrtt_host_t host; // first, handed to the plugins
+    void *lib[PLUGIN_MAX];
+    int libs;
+    const char *loading; // plugin being initialized, for the log messages
+    plugin_handler_t handler[PLUGIN_MAX_HANDLERS];
+    int handlers;
+    uint32_t flags; // union of the handler flags
+    int pooled;     // YRTT_PARALLEL handlers are called from the worker pool (pool.h), set by the tool
+    int active;
+} plugin_host_t;
+
+void plugin_init(plugin_host_t *ph);
+/* spec = "LIB[,ARGS]", ARGS is passed to yrtt_plugin_init() (empty string if missing) */
+int plugin_load(plugin_host_t *ph, const char *spec);
+/* 1 if a handler wants the channel data (YRTT_DATA) */
+int plugin_wants(const plugin_host_t *ph, int channel);
+/* Handlers called in place */
+void plugin_data(plugin_host_t *ph, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns);
+void plugin_frame(plugin_host_t *ph, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns);
+/* Handlers called from the worker pool: 1 if one wants flag (YRTT_DATA or YRTT_FRAMES) of the channel */
+int plugin_pooled(const plugin_host_t *ph, uint32_t flag, int channel);
+void plugin_pooled_data(plugin_host_t *ph, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns);
+void plugin_pooled_frame(plugin_host_t *ph, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns);
+/* The target streams restarted */
+void plugin_restart(plugin_host_t *ph);
+void plugin_unload(plugin_host_t *ph);
+
+#endif
@@ -0,0 +1,261 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/* GCC atomics, the tree is C99 */
+#define POOL_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define POOL_ADD(p, v) __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define POOL_SUB(p, v) __atomic_sub_fetch((p), (v), __ATOMIC_ACQ_REL)
+
+/* Time between two checks of a full pool or of a sync */
+#define POOL_WAIT_US 100
+
+struct pool_task
+{
+    pool_task_t *next;
+    pool_fn_t fn;
+    void *ctx;
+    uint64_t ts_ns;
+    uint32_t len;
+    uint8_t data[];
+};
+
+static void pool_push_bottom(pool_deque_t *d, pool_strand_t *s)
+{
+    pthread_mutex_lock(&d->lock);
+    d->ring[d->bottom++ % POOL_STRANDS] = s;
+    pthread_mutex_unlock(&d->lock);
+}
+
+/* Behind every other strand of the deque */
+static void pool_push_top(pool_deque_t *d, pool_strand_t *s)
+{
+    pthread_mutex_lock(&d->lock);
+    d->ring[--d->top % POOL_STRANDS] = s;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static pool_strand_t *pool_pop_bottom(pool_deque_t *d)
+{
+    pool_strand_t *s = NULL;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom != d->top)
+        s = d->ring[--d->bottom % POOL_STRANDS];
+    pthread_mutex_unlock(&d->lock);
+    return s;
+}
+
+static pool_strand_t *pool_steal_top(pool_deque_t *d)
+{
+    pool_strand_t *s = NULL;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom != d->top)
+        s = d->ring[d->top++ % POOL_STRANDS];
+    pthread_mutex_unlock(&d->lock);
+    return s;
+}
+
+/* Own newest strand, or the oldest one of another worker */
+static pool_strand_t *pool_take(pool_worker_t *w)
+{
+    pool_t *p = w->pool;
+    pool_strand_t *s = pool_pop_bottom(&w->deque);
+
+    for (int i = 1; (s == NULL) && (i < p->workers); i++)
+    {
+        s = pool_steal_top(&p->worker[(w->index + i) % p->workers].deque);
+        if (s)
+            w->steals++;
+    }
+    return s;
+}
+
+/* Run up to POOL_BATCH tasks of a strand, returns 1 when it still has some */
+static int pool_run(pool_worker_t *w, pool_strand_t *s)
+{
+    pool_t *p = w->pool;
+
+    for (int n = 0; n < POOL_BATCH; n++)
+    {
+        pool_task_t *t;
+
+        pthread_mutex_lock(&s->lock);
+        /* a stolen strand now has its state in this worker cache, the next submit queues it here */
+        s->worker = w->index;
+        t = s->head;
+        if (t == NULL)
+        {
+            s->scheduled = 0;
+            pthread_mutex_unlock(&s->lock);
+            return 0;
+        }
+        s->head = t->next;
+        if (s->head == NULL)
+            s->tail = NULL;
+        pthread_mutex_unlock(&s->lock);
+
+        t->fn(t->ctx, (int)(s - p->strand), t->data, t->len, t->ts_ns);
+        POOL_SUB(&p->pending_bytes, t->len);
+        POOL_SUB(&p->pending, 1);
+        free(t);
+        w->tasks++;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    if (s->head == NULL)
+    {
+        s->scheduled = 0;
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return 1;
+}
+
+static void *pool_worker(void *arg)
+{
+    pool_worker_t *w = arg;
+    pool_t *p = w->pool;
+
+    while (1)
+    {
+        pool_strand_t *s = pool_take(w);
+
+        if (s == NULL)
+        {
+            if (!p->running)
+                break;
+            sem_wait(&p->wake);
+            continue;
+        }
+
+        if (pool_run(w, s))
+        {
+            pool_push_top(&w->deque, s);
+            sem_post(&p->wake); /* an idle worker may take it */
+        }
+    }
+    return NULL;
+}
+
+int pool_init(pool_t *p, int workers, uint64_t max_pending)
+{
+    memset(p, 0, sizeof(*p));
+    if ((workers < 1) || (workers > POOL_MAX_WORKERS))
+        return -1;
+
+    p->max_pending = max_pending;
+    p->running = 1;
+    sem_init(&p->wake, 0, 0);
+    for (int i = 0; i < POOL_STRANDS; i++)
+    {
+        pthread_mutex_init(&p->strand[i].lock, NULL);
+        p->strand[i].worker = i % workers;
+    }
+    for (int i = 0; i < POOL_MAX_WORKERS; i++)
+    {
+        p->worker[i].pool = p;
+        p->worker[i].index = i;
+        pthread_mutex_init(&p->worker[i].deque.lock, NULL);
+    }
+    for (int i = 0; i < workers; i++)
+    {
+        if (pthread_create(&p->worker[i].thread, NULL, pool_worker, &p->worker[i]) != 0)
+        {
+            p->workers = i;
+            p->active = 1;
+            pool_stop(p);
+            return -1;
+        }
+        p->workers = i + 1;
+    }
+    p->active = 1;
+    return 0;
+}
+
+void pool_submit(pool_t *p, int key, pool_fn_t fn, void *ctx, const uint8_t *data, uint32_t len, uint64_t ts_ns)
+{
+    pool_strand_t *s = &p->strand[key % POOL_STRANDS];
+    pool_task_t *t;
+    int stalled = 0, worker;
+
+    while ((POOL_LOAD(&p->pending) > 0) && (POOL_LOAD(&p->pending_bytes) + len > p->max_pending))
+    {
+        stalled = 1;
+        usleep(POOL_WAIT_US);
+    }
+    if (stalled)
+        p->stalls++;
+
+    t = malloc(sizeof(pool_task_t) + len);
+    if (t == NULL)
+    {
+        /* keep the order, the channel decoder runs here */
+        pool_sync(p);
+        fn(ctx, key % POOL_STRANDS, data, len, ts_ns);
+        return;
+    }
+    t->next = NULL;
+    t->fn = fn;
+    t->ctx = ctx;
+    t->ts_ns = ts_ns;
+    t->len = len;
+    if (len > 0)
+        memcpy(t->data, data, len);
+    POOL_ADD(&p->pending_bytes, len);
+    POOL_ADD(&p->pending, 1);
+    p->submitted++;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->tail)
+        s->tail->next = t;
+    else
+        s->head = t;
+    s->tail = t;
+    if (s->scheduled)
+    {
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    s->scheduled = 1;
+    worker = s->worker;
+    pthread_mutex_unlock(&s->lock);
+
+    pool_push_bottom(&p->worker[worker].deque, s);
+    sem_post(&p->wake);
+}
+
+void pool_sync(pool_t *p)
+{
+    if (!p->active)
+        return;
+
+    while (POOL_LOAD(&p->pending) != 0)
+        usleep(POOL_WAIT_US);
+}
+
+void pool_stop(pool_t *p)
+{
+    if (!p->active)
+        return;
+
+    pool_sync(p);
+    p->running = 0;
+    for (int i = 0; i < p->workers; i++)
+        sem_post(&p->wake);
+    for (int i = 0; i < p->workers; i++)
+        pthread_join(p->worker[i].thread, NULL);
+
+    sem_destroy(&p->wake);
+    for (int i = 0; i < POOL_STRANDS; i++)
+        pthread_mutex_destroy(&p->strand[i].lock);
+    for (int i = 0; i < POOL_MAX_WORKERS; i++)
+        pthread_mutex_destroy(&p->worker[i].deque.lock);
+    p->active = 0;
+}
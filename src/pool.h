@@ -0,0 +1,77 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+/* Worker pool for the per channel decoders (J-Scope, SystemView, plugins), so heavy channels spread
+ * over several cores instead of all running on the output thread.
+ * Tasks are grouped in strands, one per key (the channel): a strand runs one task at a time, in the
+ * order they were submitted, on any worker. A strand with work is queued on the deque of the worker
+ * that ran it last (its decoder state is in that cache); a worker takes its newest strand first, idle
+ * workers steal the oldest strand of the others. A strand is requeued behind the others of its worker
+ * after POOL_BATCH tasks so one busy channel doesn't hold a worker.
+ * The data of a task is copied, submit waits while more than max_pending bytes are queued. */
+
+#define POOL_MAX_WORKERS 32
+#define POOL_STRANDS 256 /* keys 0..255: RTT up channels and SWO ports (128 + N) */
+#define POOL_BATCH 16
+
+typedef void (*pool_fn_t)(void *ctx, int key, const uint8_t *data, uint32_t len, uint64_t ts_ns);
+
+typedef struct pool_task pool_task_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pool_task_t *head, *tail;
+    int scheduled; // in a deque or running
+    int worker;    // last worker that ran it
+} pool_strand_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    pool_strand_t *ring[POOL_STRANDS]; // a strand is in one deque at most
+    uint32_t top;                      // oldest, stolen from here
+    uint32_t bottom;                   // newest, the owner takes from here
+} pool_deque_t;
+
+struct pool;
+
+typedef struct
+{
+    struct pool *pool;
+    int index;
+    pthread_t thread;
+    pool_deque_t deque;
+    uint64_t tasks;
+    uint64_t steals;
+} pool_worker_t;
+
+typedef struct pool
+{
+    pool_worker_t worker[POOL_MAX_WORKERS];
+    int workers;
+    pool_strand_t strand[POOL_STRANDS];
+    sem_t wake;
+    volatile int running;
+    uint64_t pending;       // tasks not completed yet
+    uint64_t pending_bytes; // their data
+    uint64_t max_pending;
+    uint64_t submitted;
+    uint64_t stalls; // submits that had to wait for room
+    int active;
+} pool_t;
+
+/* Start workers threads (1..POOL_MAX_WORKERS), max_pending = bytes of queued data before submit waits */
+int pool_init(pool_t *p, int workers, uint64_t max_pending);
+/* Queue fn(ctx, key, copy of data, len, ts_ns) behind the previous tasks of the same key */
+void pool_submit(pool_t *p, int key, pool_fn_t fn, void *ctx, const uint8_t *data, uint32_t len, uint64_t ts_ns);
+/* Wait until every submitted task completed */
+void pool_sync(pool_t *p);
+/* Sync, then stop the workers */
+void pool_stop(pool_t *p);
+
+#endif
@@ -0,0 +1,174 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "profiler.h"
+#include "clocksync.h"
+#include "timebase.h"
+
+/* p = profiler to initialize
+ * elf_path = firmware ELF used to symbolize the samples
+ * prefix = output files prefix
+ * rate_hz = wanted sampling rate, the probe round trip is the real limit */
+int profiler_init(profiler_t *p, const char *elf_path, const char *prefix, uint32_t rate_hz)
+{
+    memset(p, 0, sizeof(*p));
+    if (elf_load(&p->elf, elf_path) != 0)
+        return -1;
+
+    p->counts = calloc(p->elf.count ? p->elf.count : 1, sizeof(uint64_t));
+    if (p->counts == NULL)
+    {
+        elf_free(&p->elf);
+        return -1;
+    }
+
+    p->prefix = prefix;
+    p->period_ns = rate_hz ? 1000000000ull / rate_hz : 0;
+    p->last_dump_ns = timebase_now_ns();
+    p->active = 1;
+    return 0;
+}
+
+static void profiler_add(profiler_t *p, uint32_t pc)
+{
+    const elf_symbol_t *s;
+
+    p->total++;
+    if (pc == 0xFFFFFFFF)
+    {
+        p->idle++;
+        return;
+    }
+
+    s = elf_find_function(&p->elf, pc & ~1u);
+    if (s)
+        p->counts[s - p->elf.syms]++;
+    else
+        p->unknown++;
+}
+
+void profiler_run(profiler_t *p, stlink_t *sl, uint64_t until_ns)
+{
+    uint32_t demcr = 0, pc;
+    uint64_t now = timebase_now_ns();
+    uint64_t next = now;
+
+    if (!p->active)
+        return;
+
+    /* PCSR needs the DWT unit to be enabled, checked once per poll interval since this is called in short
+     * slices when other tasks share the idle time */
+    if (now - p->trcena_ns >= PROFILER_TRCENA_CHECK_NS)
+    {
+        p->trcena_ns = now;
+        if ((stlink_read_debug32(sl, DEMCR, &demcr) == 0) && ((demcr & DEMCR_TRCENA) == 0))
+            stlink_write_debug32(sl, DEMCR, demcr | DEMCR_TRCENA);
+    }
+
+    while (now < until_ns)
+    {
+        if (now >= next)
+        {
+            if (stlink_read_debug32(sl, DWT_PCSR, &pc) != 0)
+                break;
+            profiler_add(p, pc);
+            next += p->period_ns;
+            if (next < now)
+                next = now; /* the probe is slower than the wanted rate, don't try to catch up */
+        }
+        else
+        {
+            struct timespec ts = {0, (long)(next - now)};
+            nanosleep(&ts, NULL);
+        }
+        now = timebase_now_ns();
+    }
+
+    if (now - p->last_dump_ns >= PROFILER_DUMP_INTERVAL_NS)
+        profiler_dump(p);
+}
+
+static int profiler_cmp_count(const void *a, const void *b, void *ctx)
+{
+    const uint64_t *counts = ctx;
+    uint64_t ca = counts[*(const size_t *)a], cb = counts[*(const size_t *)b];
+
+    return (ca < cb) - (ca > cb);
+}
+
+/* Rewrite the flat profile and the folded stacks with everything sampled so far */
+int profiler_dump(profiler_t *p)
+{
+    char path[4096];
+    size_t *order;
+    size_t used = 0;
+    FILE *flat, *folded;
+
+    p->last_dump_ns = timebase_now_ns();
+    if (p->total == 0)
+        return 0;
+
+    order = malloc((p->elf.count ? p->elf.count : 1) * sizeof(size_t));
+    if (order == NULL)
+        return -1;
+    for (size_t i = 0; i < p->elf.count; i++)
+    {
+        if (p->counts[i])
+            order[used++] = i;
+    }
+    qsort_r(order, used, sizeof(size_t), profiler_cmp_count, p->counts);
+
+    snprintf(path, sizeof(path), "%s.txt", p->prefix);
+    flat = fopen(path, "w");
+    snprintf(path, sizeof(path), "%s.folded", p->prefix);
+    folded = fopen(path, "w");
+    if ((flat == NULL) || (folded == NULL))
+    {
+        if (flat)
+            fclose(flat);
+        if (folded)
+            fclose(folded);
+        free(order);
+        return -1;
+    }
+
+    fprintf(flat, "%llu samples\n\n%12s %8s  %s\n", (unsigned long long)p->total, "samples", "%", "function");
+    for (size_t i = 0; i < used; i++)
+    {
+        const elf_symbol_t *s = &p->elf.syms[order[i]];
+        uint64_t c = p->counts[order[i]];
+
+        fprintf(flat, "%12llu %7.2f%%  %s\n", (unsigned long long)c, 100.0 * c / p->total, s->name);
+        fprintf(folded, "%s %llu\n", s->name, (unsigned long long)c);
+    }
+    if (p->unknown)
+    {
+        fprintf(flat, "%12llu %7.2f%%  [unknown]\n", (unsigned long long)p->unknown, 100.0 * p->unknown / p->total);
+        fprintf(folded, "[unknown] %llu\n", (unsigned long long)p->unknown);
+    }
+    if (p->idle)
+    {
+        fprintf(flat, "%12llu %7.2f%%  [no pc]\n", (unsigned long long)p->idle, 100.0 * p->idle / p->total);
+        fprintf(folded, "[no pc] %llu\n", (unsigned long long)p->idle);
+    }
+
+    fclose(flat);
+    fclose(folded);
+    free(order);
+    return 0;
+}
+
+void profiler_close(profiler_t *p)
+{
+    if (!p->active)
+        return;
+
+    profiler_dump(p);
+    free(p->counts);
+    elf_free(&p->elf);
+    memset(p, 0, sizeof(*p));
+}
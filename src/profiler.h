@@ -0,0 +1,40 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+#include <stlink.h>
+
+#include "elf_symbols.h"
+
+/* Statistical profiler: DWT_PCSR holds a recent PC of the running core and can be read over the
+ * debug port without halting it. The samples are taken between two RTT polls, on the same probe
+ * session, symbolized against the firmware ELF and written as
+ *   <prefix>.txt     flat profile (samples, percentage, function)
+ *   <prefix>.folded  folded stacks for flamegraph.pl, one frame deep since only the PC is known */
+
+#define DWT_PCSR 0xE000101C
+#define PROFILER_DUMP_INTERVAL_NS (10ull * 1000000000ull)
+#define PROFILER_TRCENA_CHECK_NS (100ull * 1000000ull)
+
+typedef struct
+{
+    elf_symbols_t elf;
+    uint64_t *counts; // per symbol
+    uint64_t unknown; // PC outside of any function
+    uint64_t idle;    // no PC available (core halted or sleeping with the debug clock off)
+    uint64_t total;
+    uint64_t period_ns;
+    uint64_t last_dump_ns;
+    uint64_t trcena_ns; // last check of DEMCR.TRCENA
+    const char *prefix;
+    int active;
+} profiler_t;
+
+int profiler_init(profiler_t *p, const char *elf_path, const char *prefix, uint32_t rate_hz);
+/* Take samples at the configured rate until the host monotonic time reaches until_ns */
+void profiler_run(profiler_t *p, stlink_t *sl, uint64_t until_ns);
+int profiler_dump(profiler_t *p);
+void profiler_close(profiler_t *p);
+
+#endif
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+
+#include <poll.h>
+#include <string.h>
+
+#include "reactor.h"
+#include "timebase.h"
+
+/* libusb file descriptors watched per probe context (device, event and timer fds) */
+#define REACTOR_FDS_PER_PROBE 8
+
+void reactor_init(reactor_t *r, uint32_t interval_us, uint32_t quantum, reactor_event_t event, void *ctx)
+{
+    memset(r, 0, sizeof(*r));
+    r->interval_us = interval_us;
+    r->quantum = quantum ? quantum : REACTOR_QUANTUM;
+    r->event = event;
+    r->event_ctx = ctx;
+}
+
+int reactor_add(reactor_t *r, rtt_session_t *s)
+{
+    if (r->count >= REACTOR_MAX)
+        return -1;
+
+    memset(&r->slot[r->count], 0, sizeof(reactor_slot_t));
+    r->slot[r->count].s = s;
+    r->slot[r->count].state = RTT_NO_PROBE;
+    s->rx_max = r->quantum;
+    return r->count++;
+}
+
+static void reactor_state(reactor_t *r, int i, int result)
+{
+    if (r->slot[i].state == result)
+        return;
+    r->slot[i].state = result;
+    if (r->event)
+        r->event(r->event_ctx, i, result);
+}
+
+/* Connect and find the control block (blocking), returns 1 when the session can be polled */
+static int reactor_connect(reactor_t *r, int i, uint64_t now)
+{
+    rtt_session_t *s = r->slot[i].s;
+    int err = RTT_OK;
+
+    if (s->sl == NULL)
+    {
+        err = rtt_open(s);
+        if (err != RTT_OK)
+            rtt_forget(s); /* the target may have changed */
+    }
+    if ((err == RTT_OK) && (s->cb.cb_addr == 0))
+    {
+        err = rtt_locate(s);
+        if (err == RTT_LOST)
+            rtt_close(s);
+    }
+
+    reactor_state(r, i, err);
+    if (err != RTT_OK)
+    {
+        r->slot[i].due_ns = now + REACTOR_RETRY_MS * 1000000ull;
+        return 0;
+    }
+    return 1;
+}
+
+/* Hand the data of a finished poll to the sinks and schedule the next one */
+static void reactor_finish(reactor_t *r, int i, uint64_t now)
+{
+    reactor_slot_t *slot = &r->slot[i];
+    rtt_session_t *s = slot->s;
+    int more = 0;
+
+    slot->inflight = 0;
+    if (rtt_poll_finish(s) != 0)
+    {
+        rtt_close(s);
+        rtt_forget(s);
+        reactor_state(r, i, RTT_LOST);
+        slot->due_ns = now; /* reconnect at the next turn */
+        return;
+    }
+
+    slot->polls++;
+    for (int ch = 0; ch < s->cb.MaxNumUpBuffers; ch++)
+    {
+        slot->bytes += s->rx[ch].len;
+        if (s->rx[ch].avail > s->rx[ch].len)
+            more = 1;
+    }
+    /* left with data: polled again at the next turn, after every other due session */
+    slot->due_ns = more ? now : now + r->interval_us * 1000ull;
+}
+
+void reactor_run(reactor_t *r, int timeout_ms)
+{
+    struct pollfd fds[REACTOR_MAX * REACTOR_FDS_PER_PROBE];
+    int first_fd[REACTOR_MAX + 1];
+    int nfds = 0, ready = 0, start = r->cursor;
+    uint64_t now = timebase_now_ns();
+    uint64_t wait_ns = (uint64_t)timeout_ms * 1000000;
+
+    if (r->count == 0)
+        return;
+
+    /* start what is due, in turn */
+    for (int n = 0; n < r->count; n++)
+    {
+        int i = (start + n) % r->count;
+        reactor_slot_t *slot = &r->slot[i];
+        rtt_session_t *s = slot->s;
+
+        if (slot->inflight || (slot->due_ns > now))
+            continue;
+        if (((s->sl == NULL) || (s->cb.cb_addr == 0)) && !reactor_connect(r, i, now))
+            continue;
+        if (rtt_poll_start(s) == 0)
+            slot->inflight = 1;
+    }
+    r->cursor = (start + 1) % r->count;
+
+    /* wait for the transfers of every probe, or the next due session */
+    now = timebase_now_ns();
+    for (int i = 0; i < r->count; i++)
+    {
+        reactor_slot_t *slot = &r->slot[i];
+        rtt_session_t *s = slot->s;
+
+        first_fd[i] = nfds;
+        if (slot->inflight && rtt_poll_busy(s))
+        {
+            const struct libusb_pollfd **pfd = usbpipe_pollfds(&s->pipe);
+            struct timeval tv;
+
+            for (int k = 0; pfd && pfd[k] && (k < REACTOR_FDS_PER_PROBE); k++)
+            {
+                fds[nfds].fd = pfd[k]->fd;
+                fds[nfds].events = pfd[k]->events;
+                fds[nfds].revents = 0;
+                nfds++;
+            }
+            libusb_free_pollfds(pfd);
+            if ((libusb_get_next_timeout(s->pipe.ctx, &tv) == 1) &&
+                ((uint64_t)tv.tv_sec * 1000000000ull + tv.tv_usec * 1000ull < wait_ns))
+                wait_ns = (uint64_t)tv.tv_sec * 1000000000ull + tv.tv_usec * 1000ull;
+        }
+        else if (slot->inflight)
+        {
+            ready = 1; /* done without waiting (blocking transfers, or failed) */
+        }
+        else if (slot->due_ns <= now)
+        {
+            ready = 1;
+        }
+        else if (slot->due_ns - now < wait_ns)
+        {
+            wait_ns = slot->due_ns - now;
+        }
+    }
+    first_fd[r->count] = nfds;
+
+    if (poll(fds, nfds, ready ? 0 : (int)((wait_ns + 999999) / 1000000)) >= 0)
+    {
+        /* completions, the next transfers of every poll are started from there */
+        for (int i = 0; i < r->count; i++)
+        {
+            struct timeval tv;
+            int woke = 0;
+
+            if (first_fd[i] == first_fd[i + 1])
+                continue;
+            for (int k = first_fd[i]; k < first_fd[i + 1]; k++)
+                woke |= (fds[k].revents != 0);
+            /* transfer timeouts, when libusb has no timer fd */
+            if (!woke && (libusb_get_next_timeout(r->slot[i].s->pipe.ctx, &tv) == 1))
+                woke = (tv.tv_sec == 0) && (tv.tv_usec == 0);
+            if (woke)
+                usbpipe_events(&r->slot[i].s->pipe);
+        }
+    }
+
+    /* data to the sinks, in the same order */
+    now = timebase_now_ns();
+    for (int n = 0; n < r->count; n++)
+    {
+        int i = (start + n) % r->count;
+
+        if (r->slot[i].inflight && !rtt_poll_busy(r->slot[i].s))
+            reactor_finish(r, i, now);
+    }
+}
+
+void reactor_close(reactor_t *r)
+{
+    for (int i = 0; i < r->count; i++)
+    {
+        rtt_close(r->slot[i].s); /* cancels what is in flight */
+        r->slot[i].inflight = 0;
+    }
+}
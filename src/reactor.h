@@ -0,0 +1,60 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+
+#include "rtt.h"
+
+/* Single thread event loop for several probes (racks of boards). Every session is polled in steps
+ * (rtt_poll_start() / rtt_poll_finish()): the transfers of all the probes are in flight together and
+ * complete from one poll() on the libusb file descriptors of every probe context, instead of one
+ * blocking loop or thread per board.
+ *
+ * Fairness: the sessions are served round robin with one poll in flight each, and a poll drains at most
+ * `quantum` bytes per channel, so a chatty target gets the same share of a turn as the others. A
+ * session left with data is polled again at the next turn, the others once `interval_us` elapsed.
+ * Sessions without a USB pipeline (V1 probes, usb_depth < 2) are polled blocking in their turn.
+ *
+ * Connecting and searching the control block (rtt_open(), rtt_locate()) are blocking, they only happen
+ * when a board shows up, at most every REACTOR_RETRY_MS per session. */
+
+#define REACTOR_MAX 64
+#define REACTOR_RETRY_MS 1000
+#define REACTOR_QUANTUM 4096
+
+/* A session changed state: result = RTT_OK once the control block is found, else the rtt_service()
+ * result that ended the previous state (RTT_NO_PROBE, RTT_NO_TARGET, RTT_SEARCHING, RTT_LOST) */
+typedef void (*reactor_event_t)(void *ctx, int index, int result);
+
+typedef struct
+{
+    rtt_session_t *s;
+    uint64_t due_ns; // next poll or connection attempt
+    int state;       // last result, RTT_OK while polled
+    int inflight;    // poll started, not finished yet
+    uint64_t polls;
+    uint64_t bytes;
+} reactor_slot_t;
+
+typedef struct
+{
+    reactor_slot_t slot[REACTOR_MAX];
+    int count;
+    int cursor; // first session of the next turn
+    uint32_t interval_us;
+    uint32_t quantum;
+    reactor_event_t event;
+    void *event_ctx;
+} reactor_t;
+
+/* quantum = bytes per channel and poll (0 = REACTOR_QUANTUM), event may be NULL */
+void reactor_init(reactor_t *r, uint32_t interval_us, uint32_t quantum, reactor_event_t event, void *ctx);
+/* The session is initialized (rtt_init()), returns its index or -1 when full */
+int reactor_add(reactor_t *r, rtt_session_t *s);
+/* One turn: start the polls that are due, wait for the transfers (at most timeout_ms), hand the data
+ * of the finished polls to the sinks */
+void reactor_run(reactor_t *r, int timeout_ms);
+/* Close every session */
+void reactor_close(reactor_t *r);
+
+#endif
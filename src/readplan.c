@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "readplan.h"
+
+void readplan_init(readplan_t *rp)
+{
+    memset(rp, 0, sizeof(*rp));
+}
+
+int readplan_add(readplan_t *rp, uint32_t addr, uint32_t len, uint8_t *dst)
+{
+    if (len == 0)
+        return 0;
+    if ((len > READPLAN_MAX_LEN) || (addr + len < addr))
+        return -1;
+    if (rp->count >= READPLAN_MAX)
+        return -1;
+
+    rp->r[rp->count].addr = addr;
+    rp->r[rp->count].len = len;
+    rp->r[rp->count].dst = dst;
+    rp->count++;
+    return 0;
+}
+
+static int readplan_cmp(const void *a, const void *b)
+{
+    const readplan_range_t *ra = a, *rb = b;
+
+    return (ra->addr > rb->addr) - (ra->addr < rb->addr);
+}
+
+/* Number of 32 bit transfers for [start, end), as split by xfer_read() */
+static uint32_t readplan_transfers(const xfer_caps_t *caps, uint32_t start, uint32_t end)
+{
+    uint32_t n = 0;
+
+    start &= ~3u;
+    end = (end + 3) & ~3u;
+    while (start < end)
+    {
+        uint32_t chunk = XFER_TAR_BLOCK - (start % XFER_TAR_BLOCK);
+
+        if (chunk > caps->rw32_max)
+            chunk = caps->rw32_max;
+        start += chunk;
+        n++;
+    }
+    return n;
+}
+
+static double readplan_cost(const xfer_caps_t *caps, uint32_t start, uint32_t end)
+{
+    return readplan_transfers(caps, start, end) * (double)caps->overhead_ns + (double)(end - start) * caps->byte_ns;
+}
+
+/* Room for n bytes of merged spans */
+static int readplan_scratch(readplan_t *rp, uint32_t n)
+{
+    if (n > rp->scratch_size)
+    {
+        uint8_t *grown = realloc(rp->scratch, n);
+
+        if (grown == NULL)
+            return -1;
+        rp->scratch = grown;
+        rp->scratch_size = n;
+    }
+    return 0;
+}
+
+/* Every span is read, hand each range its part */
+static void readplan_done(void *ctx, int err)
+{
+    readplan_t *rp = ctx;
+
+    for (int n = 0; (err == 0) && (n < rp->spans); n++)
+    {
+        for (int i = rp->first[n]; i < rp->first[n + 1]; i++)
+            memcpy(rp->r[i].dst, rp->span[n].buf + (rp->r[i].addr - rp->span[n].addr), rp->r[i].len);
+    }
+
+    rp->count = 0;
+    rp->spans = 0;
+    rp->err = err;
+    if (rp->done)
+        rp->done(rp->done_ctx, err);
+}
+
+void readplan_start(readplan_t *rp, stlink_t *sl, const xfer_caps_t *caps, xfer_done_t done, void *ctx)
+{
+    uint32_t start, end, total = 0;
+    uint8_t *p;
+
+    rp->transactions = 0;
+    rp->bytes = 0;
+    rp->spans = 0;
+    rp->done = done;
+    rp->done_ctx = ctx;
+    if (rp->count == 0)
+    {
+        readplan_done(rp, 0);
+        return;
+    }
+
+    qsort(rp->r, rp->count, sizeof(readplan_range_t), readplan_cmp);
+
+    /* Merge first, then read every span in one go: with a USB pipeline they are all in flight together */
+    start = rp->r[0].addr;
+    end = start + rp->r[0].len;
+    rp->first[0] = 0;
+    for (int i = 1; i <= rp->count; i++)
+    {
+        if (i < rp->count)
+        {
+            uint32_t r_start = rp->r[i].addr, r_end = r_start + rp->r[i].len;
+            uint32_t merged_end = (r_end > end) ? r_end : end;
+
+            /* overlapping, or the gap is cheaper than one more transaction */
+            if ((r_start <= end) || (readplan_cost(caps, start, merged_end) <=
+                                     readplan_cost(caps, start, end) + readplan_cost(caps, r_start, r_end)))
+            {
+                end = merged_end;
+                continue;
+            }
+        }
+
+        /* widened to whole words, as xfer_read() would anyway */
+        rp->span[rp->spans].addr = start & ~3u;
+        rp->span[rp->spans].len = ((end + 3) & ~3u) - rp->span[rp->spans].addr;
+        total += rp->span[rp->spans].len;
+        rp->transactions += readplan_transfers(caps, start, end);
+        rp->bytes += end - start;
+        rp->first[++rp->spans] = i;
+        if (i < rp->count)
+        {
+            start = rp->r[i].addr;
+            end = start + rp->r[i].len;
+        }
+    }
+
+    if (readplan_scratch(rp, total) != 0)
+    {
+        readplan_done(rp, -1);
+        return;
+    }
+    p = rp->scratch;
+    for (int n = 0; n < rp->spans; n++)
+    {
+        rp->span[n].buf = p;
+        p += rp->span[n].len;
+    }
+    xfer_start(sl, caps, rp->span, rp->spans, 0, readplan_done, rp);
+}
+
+int readplan_run(readplan_t *rp, stlink_t *sl, const xfer_caps_t *caps)
+{
+    readplan_start(rp, sl, caps, NULL, NULL);
+    xfer_wait(caps);
+    return rp->err;
+}
+
+void readplan_free(readplan_t *rp)
+{
+    free(rp->scratch);
+    memset(rp, 0, sizeof(*rp));
+}
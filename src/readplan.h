@@ -0,0 +1,52 @@
+#ifndef READPLAN_H
+#define READPLAN_H
+
+#include <stdint.h>
+
+#include <stlink.h>
+
+#include "xfer.h"
+
+/* Scatter-gather reads: the ranges needed in one poll (control block, ring buffer segments, ...) are
+ * collected first, then merged into as few probe transactions as possible. Two ranges are read as one
+ * span when the extra bytes of the gap cost less than the transaction they save:
+ *   cost(span) = transactions(span) * overhead_ns + bytes(span) * byte_ns
+ * where transactions() counts the 32 bit transfers the planner in xfer.c needs for the span. */
+
+#define READPLAN_MAX 64
+#define READPLAN_MAX_LEN (1u << 20) /* larger ranges are refused, a length that went negative */
+
+typedef struct
+{
+    uint32_t addr;
+    uint32_t len;
+    uint8_t *dst;
+} readplan_range_t;
+
+typedef struct
+{
+    readplan_range_t r[READPLAN_MAX];
+    int count;
+    uint8_t *scratch; // merged spans are read here first
+    uint32_t scratch_size;
+    xfer_iov_t span[READPLAN_MAX]; // merged spans of the run in progress, in scratch
+    int first[READPLAN_MAX + 1];   // first range of every span, sorted ranges
+    int spans;
+    int err; // result of the last run
+    xfer_done_t done;
+    void *done_ctx;
+    /* statistics of the last readplan_run() */
+    uint32_t transactions;
+    uint32_t bytes;
+} readplan_t;
+
+void readplan_init(readplan_t *rp);
+/* Queue a read of len bytes at addr into dst, returns -1 when the plan is full or the range is invalid */
+int readplan_add(readplan_t *rp, uint32_t addr, uint32_t len, uint8_t *dst);
+/* Read every queued range and empty the plan */
+int readplan_run(readplan_t *rp, stlink_t *sl, const xfer_caps_t *caps);
+/* Same through xfer_start(): the ranges are filled, the plan emptied and rp->err set before done is called */
+void readplan_start(readplan_t *rp, stlink_t *sl, const xfer_caps_t *caps, xfer_done_t done, void *ctx);
+void readplan_free(readplan_t *rp);
+
+#endif
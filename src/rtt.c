@@ -0,0 +1,597 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtt.h"
+#include "timebase.h"
+
+/* target address of the control block of an up / down channel */
+#define RTT_UP_ADDR(s, ch) ((s)->cb.cb_addr + RTT_CB_HEADER + (ch) * sizeof(rtt_channel))
+#define RTT_DOWN_ADDR(s, ch) ((s)->cb.cb_addr + RTT_CB_HEADER + ((s)->cb.MaxNumUpBuffers + (ch)) * sizeof(rtt_channel))
+
+/* rtt_session_t.poll_state, each step waits for one batch of transfers */
+#define RTT_POLL_IDLE 0
+#define RTT_POLL_CB 1      /* control block and read-ahead */
+#define RTT_POLL_DATA 2    /* what the read-ahead missed */
+#define RTT_POLL_RELEASE 3 /* RdOff updates */
+#define RTT_POLL_READY 4   /* waiting for rtt_poll_finish() */
+
+void rtt_init(rtt_session_t *s, uint32_t swd_khz, rtt_sink_t sink, void *sink_ctx)
+{
+    memset(s, 0, sizeof(*s));
+    s->swd_khz = swd_khz;
+    s->sink = sink;
+    s->sink_ctx = sink_ctx;
+    readplan_init(&s->plan);
+}
+
+/* Everything sized from the control block */
+static void rtt_free_cb(rtt_session_t *s)
+{
+    free(s->cb.aUp); /* freeing NULL is allowed */
+    s->cb.aUp = NULL;
+    free(s->cb.aDown);
+    s->cb.aDown = NULL;
+    free(s->rx_area);
+    s->rx_area = NULL;
+    free(s->readahead);
+    s->readahead = NULL;
+    free(s->rx);
+    s->rx = NULL;
+    free(s->release);
+    s->release = NULL;
+    free(s->up_name);
+    s->up_name = NULL;
+    free(s->down_name);
+    s->down_name = NULL;
+}
+
+void rtt_free(rtt_session_t *s)
+{
+    rtt_forget(s);
+    readplan_free(&s->plan);
+}
+
+int rtt_read_mem(rtt_session_t *s, uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    /* No way of detecting if the target is still there, no error is returned,
+     * the only way is to detect during connect, that's why the session is
+     * usually reopened at every cycle */
+    return xfer_read(s->sl, &s->caps, addr, buf, len);
+}
+
+int rtt_write_mem(rtt_session_t *s, uint32_t addr, const uint8_t *buf, uint32_t len)
+{
+    return xfer_write(s->sl, &s->caps, addr, buf, len);
+}
+
+static stlink_t *rtt_open_first(uint32_t swd_khz)
+{
+    stlink_t *sl = NULL;
+    sl = stlink_v1_open(0, 1);
+    if (sl == NULL)
+        sl = stlink_open_usb(0, CONNECT_HOT_PLUG, NULL, swd_khz);
+
+    return sl;
+}
+
+/* V2/V3 probe with this serial number (V1 probes have none) */
+static stlink_t *rtt_open_serial(char *serial, uint32_t swd_khz)
+{
+    return stlink_open_usb(0, CONNECT_HOT_PLUG, serial, swd_khz);
+}
+
+int rtt_open(rtt_session_t *s)
+{
+    s->sl = (s->serial[0] != 0) ? rtt_open_serial(s->serial, s->swd_khz) : rtt_open_first(s->swd_khz);
+    if (s->sl == NULL)
+        return RTT_NO_PROBE;
+
+    s->sl->verbose = 0;
+    xfer_caps(&s->caps, s->sl, s->swd_khz);
+    s->caps.pipe = NULL;
+
+    if (stlink_current_mode(s->sl) == STLINK_DEV_DFU_MODE)
+    {
+        stlink_exit_dfu_mode(s->sl);
+    }
+
+    if (stlink_current_mode(s->sl) != STLINK_DEV_DEBUG_MODE)
+    {
+        stlink_enter_swd_mode(s->sl);
+    }
+
+    /* V1 probes and a depth below 2 keep the blocking transfers */
+    if ((s->usb_depth > 1) && (usbpipe_open(&s->pipe, s->sl, s->usb_depth) == 0))
+        s->caps.pipe = &s->pipe;
+
+    /* That's how we know the STLINK lib has not detected a target */
+    if (s->sl->sram_size == 0)
+    {
+        rtt_close(s);
+        return RTT_NO_TARGET;
+    }
+
+    /* The target is not reset/stopped at any moment
+     * (checked with a logic analyzer on a Nucleo G071 board) */
+    /* but we set it to run anyway */
+    stlink_run(s->sl, RUN_NORMAL);
+    return RTT_OK;
+}
+
+void rtt_close(rtt_session_t *s)
+{
+    if (s->sl)
+    {
+        usbpipe_close(&s->pipe);
+        s->caps.pipe = NULL;
+        s->poll_state = RTT_POLL_IDLE;
+        stlink_exit_debug_mode(s->sl);
+        stlink_close(s->sl);
+        s->sl = NULL;
+    }
+}
+
+void rtt_forget(rtt_session_t *s)
+{
+    s->cb.cb_addr = 0;
+    s->poll_state = RTT_POLL_IDLE;
+    rtt_free_cb(s);
+}
+
+/* Read the name of every channel, in one read plan */
+static void rtt_read_names(rtt_session_t *s)
+{
+    s->up_name = calloc(s->cb.MaxNumUpBuffers, RTT_NAME_MAX);
+    s->down_name = calloc(s->cb.MaxNumDownBuffers, RTT_NAME_MAX);
+
+    for (int ch = 0; ch < s->cb.MaxNumUpBuffers; ch++)
+    {
+        if (s->cb.aUp[ch].sName != 0)
+            readplan_add(&s->plan, s->cb.aUp[ch].sName, RTT_NAME_MAX - 1, (uint8_t *)s->up_name[ch]);
+    }
+    for (int ch = 0; ch < s->cb.MaxNumDownBuffers; ch++)
+    {
+        if (s->cb.aDown[ch].sName != 0)
+            readplan_add(&s->plan, s->cb.aDown[ch].sName, RTT_NAME_MAX - 1, (uint8_t *)s->down_name[ch]);
+    }
+    if (readplan_run(&s->plan, s->sl, &s->caps) != 0)
+    {
+        memset(s->up_name, 0, s->cb.MaxNumUpBuffers * RTT_NAME_MAX);
+        memset(s->down_name, 0, s->cb.MaxNumDownBuffers * RTT_NAME_MAX);
+    }
+
+    for (int ch = 0; ch < s->cb.MaxNumUpBuffers; ch++)
+        s->up_name[ch][strnlen(s->up_name[ch], RTT_NAME_MAX - 1)] = 0;
+    for (int ch = 0; ch < s->cb.MaxNumDownBuffers; ch++)
+        s->down_name[ch][strnlen(s->down_name[ch], RTT_NAME_MAX - 1)] = 0;
+}
+
+int rtt_locate(rtt_session_t *s)
+{
+    uint32_t ram_size = s->sl->sram_size;
+    uint8_t *buf;
+    uint32_t offset;
+
+    rtt_forget(s);
+
+    // read the whole RAM
+    buf = (uint8_t *)malloc(ram_size);
+    if ((buf == NULL) || (rtt_read_mem(s, RTT_RAM_BASE, buf, ram_size) != 0))
+    {
+        free(buf);
+        return RTT_LOST;
+    }
+
+    // find SEGGER_RTT_CB address
+    for (offset = 0; offset + RTT_CB_HEADER <= ram_size; offset++)
+    {
+        if (strncmp((char *)&buf[offset], RTT_CB_ID, 16) == 0)
+            break;
+    }
+    if (offset + RTT_CB_HEADER > ram_size)
+    {
+        free(buf);
+        return RTT_SEARCHING;
+    }
+
+    // get SEGGER_RTT_CB content
+    memcpy(s->cb.acID, ((rtt_cb_t *)(buf + offset))->acID, 16);
+    s->cb.MaxNumUpBuffers = ((rtt_cb_t *)(buf + offset))->MaxNumUpBuffers;
+    s->cb.MaxNumDownBuffers = ((rtt_cb_t *)(buf + offset))->MaxNumDownBuffers;
+    s->cb.cb_size = RTT_CB_HEADER + (s->cb.MaxNumUpBuffers + s->cb.MaxNumDownBuffers) * sizeof(rtt_channel);
+    if ((s->cb.MaxNumUpBuffers < 0) || (s->cb.MaxNumDownBuffers < 0) || (offset + s->cb.cb_size > ram_size))
+    {
+        /* the firmware is still initializing it */
+        free(buf);
+        return RTT_SEARCHING;
+    }
+
+    s->cb.cb_addr = RTT_RAM_BASE + offset;
+    s->cb.aUp = (rtt_channel *)malloc(s->cb.MaxNumUpBuffers * sizeof(rtt_channel));
+    s->cb.aDown = (rtt_channel *)malloc(s->cb.MaxNumDownBuffers * sizeof(rtt_channel));
+    s->rx_area = (uint8_t *)malloc(s->cb.MaxNumUpBuffers * RTT_RX_CHUNK);
+    s->readahead = (rtt_readahead_t *)calloc(s->cb.MaxNumUpBuffers, sizeof(rtt_readahead_t));
+    s->rx = (rtt_rx_t *)calloc(s->cb.MaxNumUpBuffers, sizeof(rtt_rx_t));
+    s->release = (xfer_iov_t *)calloc(s->cb.MaxNumUpBuffers, sizeof(xfer_iov_t));
+    memcpy(s->cb.aUp, buf + offset + RTT_CB_HEADER, s->cb.MaxNumUpBuffers * sizeof(rtt_channel));
+    memcpy(s->cb.aDown, buf + offset + RTT_CB_HEADER + s->cb.MaxNumUpBuffers * sizeof(rtt_channel),
+           s->cb.MaxNumDownBuffers * sizeof(rtt_channel));
+    free(buf);
+
+    rtt_read_names(s);
+    return RTT_OK;
+}
+
+uint32_t rtt_pending(const rtt_channel *rtt_c)
+{
+    if (rtt_c->WrOff >= rtt_c->RdOff)
+        return rtt_c->WrOff - rtt_c->RdOff;
+    return rtt_c->SizeOfBuffer - rtt_c->RdOff + rtt_c->WrOff;
+}
+
+static int rtt_drained(rtt_session_t *s, int ch)
+{
+    return (s->drain == NULL) || s->drain(s->drain_ctx, ch);
+}
+
+static uint32_t rtt_rx_max(const rtt_session_t *s)
+{
+    return ((s->rx_max == 0) || (s->rx_max > RTT_RX_CHUNK)) ? RTT_RX_CHUNK : s->rx_max;
+}
+
+/* buf = pointer to destination buffer, the data is only valid after readplan_run()
+ * buf_size = size of the destination buffer, the remaining data is left on the target for the next call
+ * rtt_c = pointer to the updated copy of the channel ringbuffer control block
+ * have = bytes already in buf (read ahead), not queued again
+ * returns the number of bytes in buf once read, to be released with rtt_release() */
+static uint32_t rtt_plan_read(rtt_session_t *s, uint8_t *buf, uint32_t buf_size, const rtt_channel *rtt_c, uint32_t have)
+{
+    uint32_t len, len2 = 0;
+
+    /* both pieces of a wrapped ring or nothing */
+    if ((rtt_c->WrOff == rtt_c->RdOff) || (s->plan.count + 2 > READPLAN_MAX))
+        return 0;
+
+    if (rtt_c->WrOff > rtt_c->RdOff)
+    {
+        len = rtt_c->WrOff - rtt_c->RdOff;
+    }
+    else
+    {
+        len = rtt_c->SizeOfBuffer - rtt_c->RdOff;
+        len2 = rtt_c->WrOff;
+    }
+    if (len > buf_size)
+        len = buf_size;
+    if (len2 > buf_size - len)
+        len2 = buf_size - len;
+    if (have > len)
+        have = len;
+
+    /* the read-ahead never goes past the first piece */
+    readplan_add(&s->plan, rtt_c->pBuffer + rtt_c->RdOff + have, len - have, buf + have);
+    readplan_add(&s->plan, rtt_c->pBuffer, len2, buf + len);
+    return len + len2;
+}
+
+/* Queue a guess of the next data of an up channel with the CB refresh, from the state seen at the
+ * previous poll. It can only be trusted when read after the WrOff it is checked against, so only
+ * buffers located after the CB are read ahead (the planner reads in ascending address order). */
+/* Returns -1 when the plan is full, nothing more can be added to it */
+static int rtt_plan_readahead(rtt_session_t *s, int ch)
+{
+    rtt_readahead_t *ra = &s->readahead[ch];
+    const rtt_channel *rtt_c = &s->cb.aUp[ch];
+    uint32_t cb_end = s->cb.cb_addr + s->cb.cb_size;
+    uint32_t len = RTT_READAHEAD_MARGIN(ra->fill);
+
+    ra->len = 0;
+    if ((rtt_c->pBuffer < cb_end) || (rtt_c->RdOff >= rtt_c->SizeOfBuffer))
+        return 0;
+
+    if ((rtt_c->pBuffer - cb_end < RTT_READAHEAD_ADJACENT) && (len < RTT_READAHEAD_ADJACENT))
+        len = RTT_READAHEAD_ADJACENT;
+    if (len > rtt_rx_max(s)) /* never more than the next read will keep */
+        len = rtt_rx_max(s);
+    if (len > rtt_c->SizeOfBuffer - rtt_c->RdOff)
+        len = rtt_c->SizeOfBuffer - rtt_c->RdOff;
+    if (len == 0)
+        return 0;
+
+    if (readplan_add(&s->plan, rtt_c->pBuffer + rtt_c->RdOff, len, s->rx_area + ch * RTT_RX_CHUNK) != 0)
+        return -1;
+    ra->addr = rtt_c->pBuffer + rtt_c->RdOff;
+    ra->rd_off = rtt_c->RdOff;
+    ra->len = len;
+    return 0;
+}
+
+/* Bytes of the read-ahead that are valid data: below the new WrOff, and only if the ring was not reset */
+static uint32_t rtt_readahead_valid(const rtt_session_t *s, int ch)
+{
+    const rtt_readahead_t *ra = &s->readahead[ch];
+    const rtt_channel *rtt_c = &s->cb.aUp[ch];
+    uint32_t contiguous;
+
+    if ((ra->len == 0) || (rtt_c->RdOff != ra->rd_off) || (rtt_c->pBuffer + rtt_c->RdOff != ra->addr) ||
+        (rtt_c->WrOff >= rtt_c->SizeOfBuffer))
+        return 0;
+
+    contiguous = (rtt_c->WrOff >= rtt_c->RdOff) ? rtt_c->WrOff - rtt_c->RdOff : rtt_c->SizeOfBuffer - rtt_c->RdOff;
+    return (contiguous < ra->len) ? contiguous : ra->len;
+}
+
+/* Consume len bytes of an up channel, iov = where the new RdOff goes on the target */
+static void rtt_consume(rtt_session_t *s, int ch, uint32_t len, xfer_iov_t *iov)
+{
+    rtt_channel *rtt_c = &s->cb.aUp[ch];
+
+    rtt_c->RdOff = (rtt_c->RdOff + len) % rtt_c->SizeOfBuffer;
+    iov->addr = RTT_UP_ADDR(s, ch) + 4 * 4;
+    iov->len = 4;
+    iov->buf = (uint8_t *)&(rtt_c->RdOff);
+}
+
+/* Consume len bytes of an up channel, the new RdOff goes to the target */
+static void rtt_release(rtt_session_t *s, int ch, uint32_t len)
+{
+    xfer_iov_t iov;
+
+    rtt_consume(s, ch, len, &iov);
+    xfer_writev(s->sl, &s->caps, &iov, 1);
+}
+
+/* End of the transfers of one poll step, starts the next one */
+static void rtt_poll_step(void *ctx, int err)
+{
+    rtt_session_t *s = ctx;
+    int up = s->cb.MaxNumUpBuffers;
+    int released = 0;
+
+    /* a failed RdOff update is seen by the next poll, the data goes to the sink anyway */
+    if ((err != 0) && (s->poll_state != RTT_POLL_RELEASE))
+    {
+        s->poll_err = -1; /* nothing is released, the data will be read again */
+        s->poll_state = RTT_POLL_READY;
+        return;
+    }
+
+    switch (s->poll_state)
+    {
+    case RTT_POLL_CB:
+        s->poll_ns = timebase_now_ns();
+
+        /* Queue what the read-ahead missed, then read it all in as few transactions as possible, in steady
+         * state there is nothing left */
+        for (int ch = 0; ch < up; ch++)
+        {
+            s->rx[ch].len = 0;
+            s->rx[ch].avail = 0;
+            if (!rtt_drained(s, ch))
+                continue;
+
+            s->rx[ch].len = rtt_plan_read(s, s->rx_area + ch * RTT_RX_CHUNK, rtt_rx_max(s), &s->cb.aUp[ch],
+                                          rtt_readahead_valid(s, ch));
+            s->readahead[ch].fill = (s->readahead[ch].fill * 3 + s->rx[ch].len) / 4;
+        }
+        s->poll_state = RTT_POLL_DATA;
+        readplan_start(&s->plan, s->sl, &s->caps, rtt_poll_step, s);
+        break;
+
+    case RTT_POLL_DATA:
+        /* every RdOff in one batch, before the sinks take their time */
+        for (int ch = 0; ch < up; ch++)
+        {
+            if (s->rx[ch].len > 0)
+            {
+                s->rx[ch].avail = rtt_pending(&s->cb.aUp[ch]);
+                rtt_consume(s, ch, s->rx[ch].len, &s->release[released++]);
+            }
+        }
+        s->poll_state = RTT_POLL_RELEASE;
+        xfer_start(s->sl, &s->caps, s->release, released, 1, rtt_poll_step, s);
+        break;
+
+    case RTT_POLL_RELEASE:
+        s->poll_state = RTT_POLL_READY;
+        break;
+    }
+}
+
+int rtt_poll_start(rtt_session_t *s)
+{
+    if ((s->sl == NULL) || (s->cb.cb_addr == 0) || (s->poll_state != RTT_POLL_IDLE))
+        return -1;
+
+    /* update local copy of all ring-buffers control blocks, both arrays follow each other on the target;
+     * they go in first, the read-ahead only takes what is left of the plan */
+    if ((readplan_add(&s->plan, RTT_UP_ADDR(s, 0), s->cb.MaxNumUpBuffers * sizeof(rtt_channel), (uint8_t *)s->cb.aUp) != 0) ||
+        (readplan_add(&s->plan, RTT_DOWN_ADDR(s, 0), s->cb.MaxNumDownBuffers * sizeof(rtt_channel),
+                      (uint8_t *)s->cb.aDown) != 0))
+    {
+        s->plan.count = 0;
+        return -1;
+    }
+
+    /* the probable new data goes with the CB refresh, often in the same transaction, until the plan is full */
+    for (int ch = 0, full = 0; ch < s->cb.MaxNumUpBuffers; ch++)
+    {
+        s->readahead[ch].len = 0;
+        if (!full && rtt_drained(s, ch))
+            full = (rtt_plan_readahead(s, ch) != 0);
+    }
+
+    s->poll_err = 0;
+    s->poll_state = RTT_POLL_CB;
+    readplan_start(&s->plan, s->sl, &s->caps, rtt_poll_step, s);
+    return 0;
+}
+
+int rtt_poll_busy(const rtt_session_t *s)
+{
+    return (s->poll_state != RTT_POLL_IDLE) && (s->poll_state != RTT_POLL_READY);
+}
+
+int rtt_poll_finish(rtt_session_t *s)
+{
+    if (s->poll_state != RTT_POLL_READY)
+        return -1;
+    s->poll_state = RTT_POLL_IDLE;
+    if (s->poll_err != 0)
+        return -1;
+
+    for (int ch = 0; ch < s->cb.MaxNumUpBuffers; ch++)
+    {
+        if ((s->rx[ch].len > 0) && s->sink)
+            s->sink(s->sink_ctx, ch, s->rx_area + ch * RTT_RX_CHUNK, s->rx[ch].len, s->rx[ch].avail, s->poll_ns);
+    }
+    return 0;
+}
+
+int rtt_poll(rtt_session_t *s)
+{
+    if (rtt_poll_start(s) != 0)
+        return -1;
+    xfer_wait(&s->caps);
+    return rtt_poll_finish(s);
+}
+
+int rtt_poll_channel(rtt_session_t *s, int ch)
+{
+    uint32_t len;
+
+    if ((s->sl == NULL) || (s->cb.cb_addr == 0) || rtt_poll_busy(s) || (ch < 0) || (ch >= s->cb.MaxNumUpBuffers))
+        return -1;
+
+    readplan_add(&s->plan, RTT_UP_ADDR(s, ch), sizeof(rtt_channel), (uint8_t *)&s->cb.aUp[ch]);
+    rtt_plan_readahead(s, ch);
+    if (readplan_run(&s->plan, s->sl, &s->caps) != 0)
+        return -1;
+    s->poll_ns = timebase_now_ns();
+
+    len = rtt_plan_read(s, s->rx_area + ch * RTT_RX_CHUNK, RTT_RX_CHUNK, &s->cb.aUp[ch], rtt_readahead_valid(s, ch));
+    s->readahead[ch].fill = (s->readahead[ch].fill * 3 + len) / 4;
+    if (readplan_run(&s->plan, s->sl, &s->caps) != 0)
+        return -1;
+
+    if (len > 0)
+    {
+        uint32_t avail = rtt_pending(&s->cb.aUp[ch]);
+
+        rtt_release(s, ch, len);
+        if (s->sink)
+            s->sink(s->sink_ctx, ch, s->rx_area + ch * RTT_RX_CHUNK, len, avail, s->poll_ns);
+    }
+    return 0;
+}
+
+int rtt_read(rtt_session_t *s, int ch, uint8_t *buf, uint32_t size)
+{
+    uint32_t len;
+
+    if ((s->sl == NULL) || (s->cb.cb_addr == 0) || rtt_poll_busy(s) || (ch < 0) || (ch >= s->cb.MaxNumUpBuffers))
+        return -1;
+
+    readplan_add(&s->plan, RTT_UP_ADDR(s, ch), sizeof(rtt_channel), (uint8_t *)&s->cb.aUp[ch]);
+    if (readplan_run(&s->plan, s->sl, &s->caps) != 0)
+        return -1;
+
+    len = rtt_plan_read(s, buf, size, &s->cb.aUp[ch], 0);
+    if (readplan_run(&s->plan, s->sl, &s->caps) != 0)
+        return -1;
+
+    if (len > 0)
+        rtt_release(s, ch, len);
+    return len;
+}
+
+int rtt_write(rtt_session_t *s, int ch, const uint8_t *buf, uint32_t len)
+{
+    rtt_channel *rtt_c;
+    uint32_t original_len = len;
+    xfer_iov_t iov[3]; /* up to two segments and WrOff, written in order */
+    int n = 0;
+
+    if ((s->sl == NULL) || (s->cb.cb_addr == 0) || rtt_poll_busy(s) || (ch < 0) || (ch >= s->cb.MaxNumDownBuffers))
+        return -1;
+    if (len == 0)
+        return 0;
+    rtt_c = &s->cb.aDown[ch];
+
+    /* we are ahead of the reading pointer, we are only limited by the size of the buffer (and the
+     * reading pointer when it is at 0, a full buffer would look empty) */
+    if (rtt_c->WrOff >= rtt_c->RdOff)
+    {
+        uint32_t to_write = len;
+        uint32_t avail = rtt_c->SizeOfBuffer - rtt_c->WrOff - ((rtt_c->RdOff == 0) ? 1 : 0);
+
+        if (to_write > avail)
+        {
+            to_write = avail;
+        }
+
+        iov[n++] = (xfer_iov_t){rtt_c->pBuffer + rtt_c->WrOff, to_write, (uint8_t *)buf};
+        buf += to_write;
+        len -= to_write;
+        rtt_c->WrOff = (rtt_c->WrOff + to_write) % rtt_c->SizeOfBuffer; /* wrap to 0 if offset = size */
+    }
+
+    if ((len > 0) && (rtt_c->WrOff < rtt_c->RdOff))
+    {
+        uint32_t to_write = len;
+        uint32_t avail = (rtt_c->RdOff - rtt_c->WrOff) - 1;
+
+        if (to_write > avail)
+        {
+            to_write = avail;
+        }
+
+        iov[n++] = (xfer_iov_t){rtt_c->pBuffer + rtt_c->WrOff, to_write, (uint8_t *)buf};
+        len -= to_write;
+        rtt_c->WrOff += to_write;
+    }
+
+    /* update the write offset on the target */
+    iov[n++] = (xfer_iov_t){RTT_DOWN_ADDR(s, ch) + (4 * 3), 4, (uint8_t *)&(rtt_c->WrOff)};
+    xfer_writev(s->sl, &s->caps, iov, n);
+
+    /* return the number of written bytes */
+    return (original_len - len);
+}
+
+int rtt_service(rtt_session_t *s)
+{
+    int err;
+
+    if (s->sl == NULL)
+    {
+        err = rtt_open(s);
+        if (err != RTT_OK)
+        {
+            /* the target may have changed */
+            rtt_forget(s);
+            return err;
+        }
+    }
+
+    if (s->cb.cb_addr == 0)
+    {
+        err = rtt_locate(s);
+        if (err != RTT_OK)
+        {
+            if (err == RTT_LOST)
+                rtt_close(s);
+            return err;
+        }
+    }
+
+    if (rtt_poll(s) != 0)
+    {
+        rtt_close(s);
+        rtt_forget(s);
+        return RTT_LOST;
+    }
+    return RTT_OK;
+}
@@ -0,0 +1,169 @@
+#ifndef RTT_H
+#define RTT_H
+
+#include <stdint.h>
+
+#include <stlink.h>
+
+#include "xfer.h"
+#include "readplan.h"
+#include "usbpipe.h"
+
+/* RTT engine: probe connection, control block discovery, draining of the up channels and writes to the
+ * down channels, for one probe. Everything lives in the rtt_session_t, there is no global state and no
+ * output, so it can be embedded (libyastrtt.a / libyastrtt.so) and several sessions can run side by side.
+ *
+ * Simplest use, one rtt_service() call per poll period:
+ *
+ *   rtt_session_t s;
+ *   rtt_init(&s, 0, my_sink, my_ctx);
+ *   while (running)
+ *   {
+ *       rtt_service(&s);               // (re)connect, find the CB, drain the up channels into my_sink
+ *       rtt_write(&s, 0, cmd, cmd_len); // anything for the target
+ *       usleep(10000);
+ *   }
+ *   rtt_close(&s);
+ *   rtt_free(&s);
+ *
+ * or with the separate steps: rtt_open(), rtt_locate(), rtt_poll() / rtt_read(). */
+
+/* Max number of bytes drained from one up channel in a single poll, anything left stays in the target
+ * buffer until the next poll. The transfer planner splits it to the probe limits */
+#define RTT_RX_CHUNK 16384
+
+/* Read-ahead of an up channel planned with the control block refresh: the smoothed amount of data per
+ * poll, with this margin, and at least RTT_READAHEAD_ADJACENT bytes when the buffer follows the CB */
+#define RTT_READAHEAD_MARGIN(fill) ((fill) + (fill) / 2)
+#define RTT_READAHEAD_ADJACENT 256
+
+/* Longest channel name read from the target */
+#define RTT_NAME_MAX 32
+
+#define RTT_RAM_BASE 0x20000000
+#define RTT_CB_ID "SEGGER RTT"
+#define RTT_CB_HEADER 24 /* acID (16 bytes) + MaxNumUpBuffers + MaxNumDownBuffers, the channels follow */
+
+/* rtt_open() / rtt_service() results */
+#define RTT_OK 0
+#define RTT_NO_PROBE -1
+#define RTT_NO_TARGET -2
+#define RTT_SEARCHING -3 /* connected, no control block in RAM (yet) */
+#define RTT_LOST -4      /* the probe or the target stopped answering, the session was closed */
+
+typedef struct
+{
+    uint32_t sName;        // Optional name. Standard names so far are: "Terminal", "SysView", "J-Scope_t4i4"
+    uint32_t pBuffer;      // Pointer to start of buffer
+    uint32_t SizeOfBuffer; // Buffer size in bytes. Note that one byte is lost, as this implementation does not fill up the buffer in order to avoid the problem of being unable to distinguish between full and empty.
+    uint32_t WrOff;        // Position of next item to be written by either target.
+    uint32_t RdOff;        // Position of next item to be read by host. Must be volatile since it may be modified by host.
+    uint32_t Flags;        // Contains configuration flags
+} rtt_channel;
+
+typedef struct
+{
+    int8_t acID[16];           // Initialized to "SEGGER RTT"
+    int32_t MaxNumUpBuffers;   // Initialized to SEGGER_RTT_MAX_NUM_UP_BUFFERS (type. 2)
+    int32_t MaxNumDownBuffers; // Initialized to SEGGER_RTT_MAX_NUM_DOWN_BUFFERS (type. 2)
+    int32_t cb_size;
+    int32_t cb_addr;
+    rtt_channel *aUp;   // Up buffers, transferring information up from target via debug probe to host
+    rtt_channel *aDown; // Down buffers, transferring information down from host via debug probe to target
+} rtt_cb_t;
+
+typedef struct
+{
+    uint32_t fill;   // smoothed bytes drained per poll
+    uint32_t addr;   // target address read ahead
+    uint32_t rd_off; // RdOff the read-ahead was planned from
+    uint32_t len;    // bytes read ahead, 0 = none
+} rtt_readahead_t;
+
+/* Up channel state of the poll in progress */
+typedef struct
+{
+    uint32_t len;   // bytes being drained
+    uint32_t avail; // bytes that were waiting
+} rtt_rx_t;
+
+/* Drained data of an up channel
+ * avail = bytes that were waiting in the channel when it was drained
+ * ts_ns = host time of the control block refresh that found them
+ * buf is only valid during the call */
+typedef void (*rtt_sink_t)(void *ctx, int channel, const uint8_t *buf, uint32_t len, uint32_t avail, uint64_t ts_ns);
+/* 1 if the up channel has to be drained by rtt_poll(), NULL drains every channel */
+typedef int (*rtt_drain_filter_t)(void *ctx, int channel);
+
+typedef struct
+{
+    stlink_t *sl;
+    uint32_t swd_khz; // SWD clock, 0 = library default
+    char serial[STLINK_SERIAL_BUFFER_SIZE]; // probe to open, empty = the first one (set before rtt_open())
+    int usb_depth;    // commands in flight, see usbpipe.h, below 2 = blocking transfers (set before rtt_open())
+    usbpipe_t pipe;
+    xfer_caps_t caps; // transfer limits of the connected probe, see xfer.h
+    readplan_t plan;  // reads of one poll, see readplan.h
+    rtt_cb_t cb;      // local copy, cb.cb_addr = 0 while not found
+    uint8_t *rx_area; // RTT_RX_CHUNK bytes per up channel
+    rtt_readahead_t *readahead; // one per up channel
+    rtt_rx_t *rx;               // one per up channel
+    xfer_iov_t *release;        // RdOff updates of a poll, one per up channel
+    uint32_t rx_max;            // bytes drained per up channel and poll, 0 = RTT_RX_CHUNK
+    int poll_state;             // asynchronous poll in progress, see rtt_poll_start()
+    int poll_err;
+    char (*up_name)[RTT_NAME_MAX]; // channel names (sName), empty if none
+    char (*down_name)[RTT_NAME_MAX];
+    uint64_t poll_ns; // host time of the last control block refresh
+    rtt_sink_t sink;
+    void *sink_ctx;
+    rtt_drain_filter_t drain;
+    void *drain_ctx;
+} rtt_session_t;
+
+void rtt_init(rtt_session_t *s, uint32_t swd_khz, rtt_sink_t sink, void *sink_ctx);
+/* Release the CB buffers and the read plan, the session must be closed */
+void rtt_free(rtt_session_t *s);
+
+/* Connect to the probe (s->serial or the first one) and its target, returns RTT_OK, RTT_NO_PROBE or
+ * RTT_NO_TARGET */
+int rtt_open(rtt_session_t *s);
+void rtt_close(rtt_session_t *s);
+
+/* Look for the control block in the target RAM, returns RTT_OK once found (buffers and channel names
+ * loaded), RTT_SEARCHING, or RTT_LOST */
+int rtt_locate(rtt_session_t *s);
+/* Forget the control block, it is searched again by the next rtt_locate() */
+void rtt_forget(rtt_session_t *s);
+
+/* Refresh the control block and drain the up channels into the sink, never waits for data,
+ * returns 0 or -1 on a probe error (nothing is lost, the data is read again by the next poll) */
+int rtt_poll(rtt_session_t *s);
+/* rtt_poll() in steps, for an event loop driving several sessions (see reactor.h):
+ * rtt_poll_start() plans the reads and starts them, the transfers complete from the probe USB events
+ * (the next ones are started from there), then rtt_poll_finish() hands the data to the sink, outside of
+ * the event handling. Without a USB pipeline everything is done by rtt_poll_start().
+ * No other access to the session while a poll is busy. */
+int rtt_poll_start(rtt_session_t *s);
+int rtt_poll_busy(const rtt_session_t *s);
+/* Once not busy: returns 0 after the data went to the sink, -1 on a probe error (as rtt_poll()) */
+int rtt_poll_finish(rtt_session_t *s);
+/* Refresh and drain a single up channel into the sink, between two full polls */
+int rtt_poll_channel(rtt_session_t *s, int channel);
+/* Drain up to size bytes of an up channel into buf without the sink, returns the bytes read or -1 */
+int rtt_read(rtt_session_t *s, int channel, uint8_t *buf, uint32_t size);
+/* Write to a down channel, as much as it has room for, returns the bytes written or -1 */
+int rtt_write(rtt_session_t *s, int channel, const uint8_t *buf, uint32_t len);
+
+/* One step of the whole cycle: connect if needed, find the CB if needed, then rtt_poll(),
+ * returns RTT_OK after a poll or the reason why there was none */
+int rtt_service(rtt_session_t *s);
+
+/* Raw target memory access through the transfer planner limits */
+int rtt_read_mem(rtt_session_t *s, uint32_t addr, uint8_t *buf, uint32_t len);
+int rtt_write_mem(rtt_session_t *s, uint32_t addr, const uint8_t *buf, uint32_t len);
+
+/* Number of bytes waiting in an up channel (local copy of the last poll) */
+uint32_t rtt_pending(const rtt_channel *rtt_c);
+
+#endif
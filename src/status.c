@@ -0,0 +1,115 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "status.h"
+#include "timebase.h"
+
+static int headless = 0;
+static FILE *log_file = NULL;
+static const char anim[4] = {'|', '/', '-', '\\'};
+static int anim_index = 0;
+static char last_progress[STATUS_MSG_MAX];
+/* messages come from the poll thread and the output thread (triggers, plugins, sinks): one line at a time */
+static pthread_mutex_t status_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void status_init(int is_headless, FILE *log)
+{
+    headless = is_headless;
+    log_file = log ? log : stderr;
+}
+
+int status_headless(void)
+{
+    return headless;
+}
+
+/* Called with status_lock held */
+static void status_json(const char *level, const char *msg)
+{
+    uint64_t now = timebase_realtime_ns();
+    time_t sec = now / 1000000000ull;
+    struct tm tm;
+    char ts[32];
+
+    gmtime_r(&sec, &tm);
+    strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+    fprintf(log_file, "{\"ts\":\"%s.%03uZ\",\"level\":\"%s\",\"msg\":\"", ts, (unsigned)(now / 1000000 % 1000), level);
+    for (const char *p = msg; *p; p++)
+    {
+        if ((*p == '"') || (*p == '\\'))
+            fprintf(log_file, "\\%c", *p);
+        else if ((unsigned char)*p < 0x20)
+            fprintf(log_file, "\\u%04x", (unsigned char)*p);
+        else
+            fputc(*p, log_file);
+    }
+    fputs("\"}\n", log_file);
+    fflush(log_file);
+}
+
+static void status_vlog(const char *level, const char *prefix, const char *fmt, va_list ap)
+{
+    char msg[STATUS_MSG_MAX];
+
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    pthread_mutex_lock(&status_lock);
+    if (headless)
+    {
+        status_json(level, msg);
+    }
+    else
+    {
+        printf("%s%s\n\r", prefix, msg);
+        fflush(stdout);
+    }
+    pthread_mutex_unlock(&status_lock);
+}
+
+void status_info(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    status_vlog("info", "=> ", fmt, ap);
+    va_end(ap);
+}
+
+void status_error(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    status_vlog("error", "", fmt, ap);
+    va_end(ap);
+}
+
+void status_progress(const char *msg)
+{
+    pthread_mutex_lock(&status_lock);
+    if (msg == NULL)
+    {
+        last_progress[0] = 0;
+    }
+    else if (!headless)
+    {
+        printf("%s %c        \r", msg, anim[anim_index]);
+        fflush(stdout);
+    }
+    else if (strcmp(msg, last_progress) != 0)
+    {
+        snprintf(last_progress, sizeof(last_progress), "%s", msg);
+        status_json("info", msg);
+    }
+    pthread_mutex_unlock(&status_lock);
+}
+
+void status_tick(void)
+{
+    pthread_mutex_lock(&status_lock);
+    anim_index = (anim_index + 1) % sizeof(anim);
+    pthread_mutex_unlock(&status_lock);
+}
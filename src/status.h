@@ -0,0 +1,23 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdio.h>
+
+/* Status messages of the tool, kept apart from the channel data on stdout.
+ * Interactive: "=> message" lines on the terminal, and a spinner line rewritten in place while waiting.
+ * Headless: one JSON object per line in the log (stderr by default), e.g.
+ *   {"ts":"2026-01-31T12:00:00.123Z","level":"info","msg":"RTT addr = 0x20000400"}
+ * and the waiting states only when they change. */
+
+#define STATUS_MSG_MAX 512
+
+void status_init(int headless, FILE *log);
+int status_headless(void);
+void status_info(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void status_error(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+/* Waiting state (no probe, searching the CB...), NULL once it is over */
+void status_progress(const char *msg);
+/* Next spinner frame, once per poll cycle */
+void status_tick(void);
+
+#endif
@@ -0,0 +1,81 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "swdclk.h"
+#include "timebase.h"
+
+/* clocks selectable by stlink_set_swdclk(), fastest first */
+static const uint32_t v2_khz[] = {4000, 1800, 1200, 950, 480, 240, 125, 100, 50, 25, 15, 5};
+static const uint32_t v3_khz[] = {24000, 8000, 3300, 1000, 200, 50, 5};
+
+static int swdclk_read(stlink_t *sl, uint32_t addr, uint8_t *out)
+{
+    if (stlink_read_mem32(sl, addr, SWDCLK_BLOCK) != 0)
+        return -1;
+    memcpy(out, sl->q_buf, SWDCLK_BLOCK);
+    return 0;
+}
+
+/* sl = open session, the target keeps running
+ * addr = start of the reference block, must not change while calibrating (flash)
+ * res = filled with the measurements of every tested clock */
+int swdclk_calibrate(stlink_t *sl, uint32_t addr, swdclk_result_t *res)
+{
+    const uint32_t *khz = (sl->version.stlink_v >= 3) ? v3_khz : v2_khz;
+    int n = (sl->version.stlink_v >= 3) ? sizeof(v3_khz) / sizeof(v3_khz[0]) : sizeof(v2_khz) / sizeof(v2_khz[0]);
+    uint8_t ref[SWDCLK_BLOCK], again[SWDCLK_BLOCK];
+    uint32_t ref_khz = 0;
+    double best_rate = 0;
+
+    memset(res, 0, sizeof(*res));
+
+    /* reference clock: the fastest one not above SWDCLK_REFERENCE_KHZ, read twice to make sure */
+    for (int i = 0; i < n; i++)
+    {
+        if (khz[i] <= SWDCLK_REFERENCE_KHZ)
+        {
+            ref_khz = khz[i];
+            break;
+        }
+    }
+    if ((stlink_set_swdclk(sl, ref_khz) != 0) || (swdclk_read(sl, addr, ref) != 0) ||
+        (swdclk_read(sl, addr, again) != 0) || (memcmp(ref, again, SWDCLK_BLOCK) != 0))
+        return -1;
+
+    for (int i = 0; (i < n) && (khz[i] >= ref_khz) && (res->steps < SWDCLK_MAX_STEPS); i++)
+    {
+        int step = res->steps++;
+        uint64_t start;
+
+        res->khz[step] = khz[i];
+        if (stlink_set_swdclk(sl, khz[i]) != 0)
+        {
+            res->errors[step] = SWDCLK_ROUNDS;
+            continue;
+        }
+
+        start = timebase_now_ns();
+        for (int r = 0; r < SWDCLK_ROUNDS; r++)
+        {
+            if ((swdclk_read(sl, addr, again) != 0) || (memcmp(ref, again, SWDCLK_BLOCK) != 0))
+                res->errors[step]++;
+        }
+        res->bytes_per_s[step] = (double)SWDCLK_BLOCK * SWDCLK_ROUNDS * 1e9 / (double)(timebase_now_ns() - start + 1);
+    }
+
+    /* slowest first, a faster clock has to bring a real gain (2%) to be worth the smaller margin */
+    for (int step = res->steps - 1; step >= 0; step--)
+    {
+        if ((res->errors[step] == 0) && (res->bytes_per_s[step] > best_rate * 1.02))
+        {
+            best_rate = res->bytes_per_s[step];
+            res->best_khz = res->khz[step];
+        }
+    }
+    if (res->best_khz == 0)
+        res->best_khz = ref_khz;
+
+    stlink_set_swdclk(sl, res->best_khz);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef SWDCLK_H
+#define SWDCLK_H
+
+#include <stdint.h>
+
+#include <stlink.h>
+
+/* SWD clock calibration: the same flash block (static, so a known reference) is read at every clock
+ * the probe supports, from the fastest down to a conservative reference clock. Each candidate is
+ * checked for read errors and for data corruption against the reference read, and timed. The fastest
+ * error free clock (by measured throughput, the USB link caps it before the SWD clock on some probes)
+ * is kept. Long or noisy cables fail silently at high clocks, corrupted data without any error. */
+
+#define SWDCLK_MAX_STEPS 16
+#define SWDCLK_BLOCK 1024
+#define SWDCLK_ROUNDS 8
+#define SWDCLK_REFERENCE_KHZ 480 /* every probe and cable is expected to be stable here */
+
+typedef struct
+{
+    int steps;
+    uint32_t khz[SWDCLK_MAX_STEPS];
+    double bytes_per_s[SWDCLK_MAX_STEPS];
+    uint32_t errors[SWDCLK_MAX_STEPS]; // failed or corrupted reads out of SWDCLK_ROUNDS
+    uint32_t best_khz;                 // 0 if the calibration could not run
+} swdclk_result_t;
+
+/* Run the calibration on block addr (SWDCLK_BLOCK bytes), the probe is left at the selected clock */
+int swdclk_calibrate(stlink_t *sl, uint32_t addr, swdclk_result_t *res);
+
+#endif
@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "swo.h"
+#include "clocksync.h"
+
+#define SWO_STATE_HEADER 0
+#define SWO_STATE_PAYLOAD 1
+#define SWO_STATE_CONTINUATION 2 /* skipping a timestamp / extension packet */
+
+void swo_init(swo_t *swo, uint32_t port_mask, uint32_t trace_hz, swo_sink_t sink, void *sink_ctx)
+{
+    memset(swo, 0, sizeof(*swo));
+    swo->port_mask = port_mask;
+    swo->trace_hz = trace_hz;
+    swo->sink = sink;
+    swo->sink_ctx = sink_ctx;
+    swo->active = 1;
+}
+
+int swo_configure(swo_t *swo, stlink_t *sl, uint32_t cpu_hz)
+{
+    uint32_t demcr = 0, dbgmcu = 0;
+    uint32_t trace_hz = swo->trace_hz;
+    uint32_t div;
+
+    if ((sl->version.flags & STLINK_F_HAS_TRACE) == 0)
+        return -2;
+
+    if ((trace_hz == 0) || (trace_hz > sl->max_trace_freq))
+        trace_hz = sl->max_trace_freq;
+    /* the TPIU divides the core clock by an integer, rounded up so the rate stays within the probe limit */
+    if (trace_hz > cpu_hz)
+        trace_hz = cpu_hz;
+    div = (cpu_hz + trace_hz - 1) / trace_hz;
+    trace_hz = cpu_hz / div;
+
+    if ((stlink_read_debug32(sl, DEMCR, &demcr) != 0) ||
+        (stlink_write_debug32(sl, DEMCR, demcr | DEMCR_TRCENA) != 0))
+        return -1;
+
+    /* STM32 specific: route the trace pins */
+    if (stlink_read_debug32(sl, DBGMCU_CR, &dbgmcu) == 0)
+        stlink_write_debug32(sl, DBGMCU_CR, dbgmcu | DBGMCU_CR_TRACE_IOEN);
+
+    stlink_write_debug32(sl, TPI_CSPSR, 1);                    /* 1 bit port */
+    stlink_write_debug32(sl, TPI_ACPR, div - 1);               /* SWO prescaler */
+    stlink_write_debug32(sl, TPI_SPPR, 2);                     /* NRZ (UART) encoding */
+    stlink_write_debug32(sl, TPI_FFCR, 0x100);                 /* no formatter, ITM packets go straight out */
+    stlink_write_debug32(sl, ITM_LAR, 0xC5ACCE55);             /* unlock */
+    stlink_write_debug32(sl, ITM_TCR, (1 << 16) | (1 << 3) | (1 << 0)); /* TraceBusID 1, DWT forwarding, ITMENA */
+    stlink_write_debug32(sl, ITM_TPR, 0xFFFFFFFF);             /* unprivileged writes on every port */
+    stlink_write_debug32(sl, ITM_TER, swo->port_mask);
+
+    if (stlink_trace_enable(sl, trace_hz) != 0)
+        return -1;
+
+    swo->state = SWO_STATE_HEADER;
+    swo->baud = trace_hz;
+    swo->configured = 1;
+    return 0;
+}
+
+/* ITM packet decoder (ARMv7-M ARM, appendix D4), one byte at a time so packets can be split between reads */
+void swo_decode(swo_t *swo, const uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t b = buf[i];
+
+        switch (swo->state)
+        {
+        case SWO_STATE_PAYLOAD:
+            if (swo->software && (swo->out_len[swo->port] < STLINK_TRACE_BUF_LEN))
+                swo->out[swo->port][swo->out_len[swo->port]++] = b;
+            if (--swo->remaining == 0)
+                swo->state = SWO_STATE_HEADER;
+            break;
+
+        case SWO_STATE_CONTINUATION:
+            if ((b & 0x80) == 0)
+                swo->state = SWO_STATE_HEADER;
+            break;
+
+        default:
+            if ((b == 0x00) || (b == 0x80))
+            {
+                /* synchronization packet, a run of zeros ended by 0x80 (reserved as a header otherwise) */
+            }
+            else if (b == 0x70)
+            {
+                swo->overflows++;
+            }
+            else if ((b & 0x03) != 0)
+            {
+                /* source packet: size code in bits 1:0, hardware source in bit 2, port in bits 7:3 */
+                swo->remaining = ((b & 0x03) == 3) ? 4 : (b & 0x03);
+                swo->software = ((b & 0x04) == 0);
+                swo->port = b >> 3;
+                swo->state = SWO_STATE_PAYLOAD;
+            }
+            else if (b & 0x80)
+            {
+                /* timestamp or extension packet with continuation bytes, we only use host time */
+                swo->state = SWO_STATE_CONTINUATION;
+            }
+            break;
+        }
+    }
+}
+
+int swo_poll(swo_t *swo, stlink_t *sl)
+{
+    uint8_t buf[STLINK_TRACE_BUF_LEN];
+    int len;
+
+    if (!swo->configured)
+        return 0;
+
+    /* the probe buffer is small, empty it completely */
+    do
+    {
+        len = stlink_trace_read(sl, buf, sizeof(buf));
+        if (len < 0)
+        {
+            swo->configured = 0;
+            return -1;
+        }
+
+        swo_decode(swo, buf, len);
+        for (int port = 0; port < SWO_PORTS; port++)
+        {
+            if (swo->out_len[port] > 0)
+            {
+                swo->sink(swo->sink_ctx, port, swo->out[port], swo->out_len[port]);
+                swo->out_len[port] = 0;
+            }
+        }
+    } while (len == sizeof(buf));
+
+    return 0;
+}
+
+void swo_stop(swo_t *swo, stlink_t *sl)
+{
+    if (swo->configured && sl)
+        stlink_trace_disable(sl);
+    swo->configured = 0;
+}
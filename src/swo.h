@@ -0,0 +1,62 @@
+#ifndef SWO_H
+#define SWO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <stlink.h>
+
+/* SWO ingest: the target TPIU/ITM is configured for NRZ output, the probe captures the trace with
+ * stlink_trace_enable() and pushes it to the host, where a streaming decoder splits the ITM packet
+ * stream into the 32 software stimulus ports. Each port is delivered as channel SWO_CHANNEL(port),
+ * next to the RTT up channels, so the sinks see one merged, timestamped stream. */
+
+#define SWO_CHANNEL_BASE 0x80
+#define SWO_CHANNEL(port) (SWO_CHANNEL_BASE + (port))
+#define SWO_PORTS 32
+
+#define ITM_STIM0 0xE0000000
+#define ITM_TER 0xE0000E00
+#define ITM_TPR 0xE0000E40
+#define ITM_TCR 0xE0000E80
+#define ITM_LAR 0xE0000FB0
+#define TPI_CSPSR 0xE0040004
+#define TPI_ACPR 0xE0040010
+#define TPI_SPPR 0xE00400F0
+#define TPI_FFCR 0xE0040304
+#define DBGMCU_CR 0xE0042004
+#define DBGMCU_CR_TRACE_IOEN (1 << 5)
+
+typedef void (*swo_sink_t)(void *ctx, int port, const uint8_t *buf, uint32_t len);
+
+typedef struct
+{
+    /* decoder state, carried between trace reads */
+    int state;
+    int port;
+    int software;
+    uint32_t remaining;
+    /* per port output of the current read */
+    uint8_t out[SWO_PORTS][STLINK_TRACE_BUF_LEN];
+    uint32_t out_len[SWO_PORTS];
+    uint32_t overflows; // ITM overflow packets seen
+    uint32_t port_mask;
+    uint32_t trace_hz; // wanted SWO bit rate, 0 = probe maximum
+    uint32_t baud;     // bit rate in use
+    int configured; // target and probe are set up for the current connection
+    swo_sink_t sink;
+    void *sink_ctx;
+    int active;
+} swo_t;
+
+void swo_init(swo_t *swo, uint32_t port_mask, uint32_t trace_hz, swo_sink_t sink, void *sink_ctx);
+/* Set up the target TPIU/ITM (cpu_hz = core clock) and start the probe capture,
+ * returns -2 when the probe has no trace support */
+int swo_configure(swo_t *swo, stlink_t *sl, uint32_t cpu_hz);
+/* Read and decode everything the probe has captured, returns -1 when the probe stopped answering */
+int swo_poll(swo_t *swo, stlink_t *sl);
+/* Feed raw trace bytes to the decoder */
+void swo_decode(swo_t *swo, const uint8_t *buf, size_t len);
+void swo_stop(swo_t *swo, stlink_t *sl);
+
+#endif
@@ -0,0 +1,65 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sysview.h"
+#include "status.h"
+
+void sysview_init(sysview_t *sv, const char *prefix)
+{
+    memset(sv, 0, sizeof(*sv));
+    sv->prefix = prefix;
+}
+
+int sysview_start(sysview_t *sv, uint32_t rtt_addr, int channel)
+{
+    char *name, when[64];
+    time_t now = time(NULL);
+
+    sysview_stop(sv);
+
+    if (asprintf(&name, "%s-%04u.SVDat", sv->prefix, sv->sessions) < 0)
+        return -1;
+    sv->f = fopen(name, "wb");
+    if (sv->f == NULL)
+    {
+        free(name);
+        return -1;
+    }
+
+    strftime(when, sizeof(when), "%d %b %Y %H:%M:%S", localtime(&now));
+    fprintf(sv->f, ";\n"
+                   "; Version     yastrtt SystemView recorder\n"
+                   "; RecordTime  %s\n"
+                   "; Interface   SWD, ST-Link\n"
+                   "; RTTAddress  0x%08X\n"
+                   "; RTTChannel  %d\n"
+                   ";\n"
+                   "; EOT\n",
+            when, rtt_addr, channel);
+
+    status_info("SystemView recording into %s", name);
+    free(name);
+    sv->sessions++;
+    sv->bytes = 0;
+    sv->active = 1;
+    return 0;
+}
+
+void sysview_write(sysview_t *sv, const uint8_t *buf, uint32_t len)
+{
+    if (!sv->active)
+        return;
+    fwrite(buf, 1, len, sv->f);
+    sv->bytes += len;
+}
+
+void sysview_stop(sysview_t *sv)
+{
+    if (sv->f)
+        fclose(sv->f);
+    sv->f = NULL;
+    sv->active = 0;
+}
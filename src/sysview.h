@@ -0,0 +1,31 @@
+#ifndef SYSVIEW_H
+#define SYSVIEW_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* SEGGER SystemView recorder: the target streams its events on the up channel named "SysView" once
+ * the host sends the start command on the down channel of the same name. Each recording session
+ * (one per target run) goes to <prefix>-NNNN.SVDat: a text header of ';' comment lines ending with
+ * "; EOT", as in the files saved by SystemView, followed by the raw event stream. */
+
+#define SYSVIEW_CHANNEL_NAME "SysView"
+#define SYSVIEW_CMD_START 1
+#define SYSVIEW_CMD_STOP 2
+
+typedef struct
+{
+    FILE *f;
+    const char *prefix;
+    uint32_t sessions;
+    uint64_t bytes; // of the current session
+    int active;
+} sysview_t;
+
+void sysview_init(sysview_t *sv, const char *prefix);
+/* Open the file of a new session, rtt_addr/channel are noted in the header */
+int sysview_start(sysview_t *sv, uint32_t rtt_addr, int channel);
+void sysview_write(sysview_t *sv, const uint8_t *buf, uint32_t len);
+void sysview_stop(sysview_t *sv);
+
+#endif
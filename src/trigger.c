@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trigger.h"
+#include "status.h"
+#include "timebase.h"
+
+static void ring_copy_in(const trigger_t *t, trigger_ring_t *r, uint64_t pos, const void *src, uint32_t n)
+{
+    uint32_t p = pos % t->ring_size;
+    uint32_t first = (n < t->ring_size - p) ? n : t->ring_size - p;
+
+    memcpy(r->buf + p, src, first);
+    memcpy(r->buf, (const uint8_t *)src + first, n - first);
+}
+
+static void ring_copy_out(const trigger_t *t, const trigger_ring_t *r, uint64_t pos, void *dst, uint32_t n)
+{
+    uint32_t p = pos % t->ring_size;
+    uint32_t first = (n < t->ring_size - p) ? n : t->ring_size - p;
+
+    memcpy(dst, r->buf + p, first);
+    memcpy((uint8_t *)dst + first, r->buf, n - first);
+}
+
+/* Append a record to the channel ring, dropping the oldest ones to make room */
+static void ring_put(trigger_t *t, trigger_ring_t *r, capture_record_t *rec, const uint8_t *buf)
+{
+    capture_record_t old;
+
+    /* a chunk bigger than the whole ring only keeps its most recent bytes */
+    if (sizeof(*rec) + rec->length > t->ring_size)
+    {
+        buf += rec->length - (t->ring_size - sizeof(*rec));
+        rec->length = t->ring_size - sizeof(*rec);
+    }
+
+    while (r->head + sizeof(*rec) + rec->length - r->tail > t->ring_size)
+    {
+        ring_copy_out(t, r, r->tail, &old, sizeof(old));
+        r->tail += sizeof(old) + old.length;
+    }
+
+    ring_copy_in(t, r, r->head, rec, sizeof(*rec));
+    ring_copy_in(t, r, r->head + sizeof(*rec), buf, rec->length);
+    r->head += sizeof(*rec) + rec->length;
+}
+
+/* t = trigger capture to initialize
+ * prefix = dump files are named <prefix>-NNNN.bin
+ * ring_size = bytes kept in memory per channel, including the record headers
+ * post = bytes of live data captured after the trigger */
+int trigger_init(trigger_t *t, const char *prefix, uint32_t ring_size, uint32_t post)
+{
+    memset(t, 0, sizeof(*t));
+    if (ring_size < 2 * sizeof(capture_record_t))
+        return -1;
+
+    t->prefix = prefix;
+    t->ring_size = ring_size;
+    t->post = post;
+    t->out.fd = -1;
+    t->active = 1;
+    return 0;
+}
+
+int trigger_set_pattern(trigger_t *t, const char *escaped)
+{
+    uint8_t *buf = malloc(strlen(escaped) + 1);
+    int ret;
+
+    if (buf == NULL)
+        return -1;
+
+    ret = match_init(&t->pattern);
+    if (ret == 0)
+    {
+        if ((match_add(&t->pattern, buf, match_unescape(escaped, buf)) < 0) || (match_build(&t->pattern) != 0))
+        {
+            match_free(&t->pattern);
+            ret = -1;
+        }
+    }
+    free(buf);
+    t->has_pattern = (ret == 0);
+    return ret;
+}
+
+int trigger_set_regex(trigger_t *t, const char *re)
+{
+    if (regcomp(&t->regex, re, REG_EXTENDED | REG_NOSUB) != 0)
+        return -1;
+
+    t->has_regex = 1;
+    return 0;
+}
+
+/* Run the regex on every complete line, lines longer than TRIGGER_LINE_MAX are checked in pieces */
+static int trigger_scan_lines(trigger_t *t, trigger_ring_t *r, const uint8_t *buf, uint32_t len)
+{
+    int hit = 0;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        if ((buf[i] != '\n') && (r->line_len < TRIGGER_LINE_MAX))
+        {
+            r->line[r->line_len++] = (char)buf[i];
+            if (r->line_len < TRIGGER_LINE_MAX)
+                continue;
+        }
+
+        r->line[r->line_len] = '\0';
+        if (regexec(&t->regex, r->line, 0, NULL, 0) == 0)
+            hit = 1;
+        r->line_len = 0;
+    }
+    return hit;
+}
+
+/* Every drained chunk goes through here: it is kept in the ring (or written to the open dump) and
+ * checked against the triggers */
+void trigger_data(trigger_t *t, uint64_t timestamp_ns, uint16_t probe, uint8_t channel, const uint8_t *buf, uint32_t len)
+{
+    trigger_ring_t *r;
+    capture_record_t rec;
+    uint32_t mask;
+    int hit = 0;
+
+    if (!t->active)
+        return;
+
+    r = &t->ch[channel];
+    if (r->buf == NULL)
+    {
+        r->buf = malloc(t->ring_size);
+        if (r->buf == NULL)
+            return;
+    }
+
+    if (t->post_left > 0)
+    {
+        capture_write(&t->out, timestamp_ns, probe, channel, CAPTURE_REC_DATA, buf, len);
+        t->post_left = (len < t->post_left) ? t->post_left - len : 0;
+        if (t->post_left == 0)
+        {
+            capture_close(&t->out);
+            status_info("Trigger dump %u complete", t->dumps);
+        }
+        return;
+    }
+
+    rec.timestamp_ns = timestamp_ns;
+    rec.probe = probe;
+    rec.channel = channel;
+    rec.type = CAPTURE_REC_DATA;
+    rec.length = len;
+    ring_put(t, r, &rec, buf);
+
+    if (t->has_pattern && (match_feed(&t->pattern, &r->match_state, buf, len, &mask) >= 0))
+        hit = 1;
+
+    if (t->has_regex && trigger_scan_lines(t, r, buf, len))
+        hit = 1;
+
+    if (hit)
+    {
+        char reason[32];
+
+        snprintf(reason, sizeof(reason), "match on channel %u", channel);
+        trigger_fire(t, timestamp_ns, reason);
+    }
+}
+
+/* Write every ring into a new dump file, oldest record first, and start capturing the post-trigger data */
+void trigger_fire(trigger_t *t, uint64_t timestamp_ns, const char *reason)
+{
+    char path[4096];
+    uint64_t pos[TRIGGER_MAX_CHANNELS];
+    uint64_t start_ns = timestamp_ns;
+    uint8_t *payload;
+    capture_record_t rec;
+
+    if (!t->active || (t->post_left > 0))
+        return;
+
+    snprintf(path, sizeof(path), "%s-%04u.bin", t->prefix, ++t->dumps);
+    status_info("Trigger (%s), dumping to %s", reason, path);
+
+    /* the dump starts at its oldest pre-trigger record, a window from 0 keeps the whole context */
+    for (int ch = 0; ch < TRIGGER_MAX_CHANNELS; ch++)
+    {
+        if ((t->ch[ch].buf == NULL) || (t->ch[ch].tail >= t->ch[ch].head))
+            continue;
+        ring_copy_out(t, &t->ch[ch], t->ch[ch].tail, &rec, sizeof(rec));
+        if (rec.timestamp_ns < start_ns)
+            start_ns = rec.timestamp_ns;
+    }
+
+    payload = malloc(t->ring_size);
+    if ((payload == NULL) ||
+        (capture_open_at(&t->out, path, start_ns, timebase_realtime_ns() - (timebase_now_ns() - start_ns)) != 0))
+    {
+        status_error("Unable to create trigger dump %s", path);
+        free(payload);
+        return;
+    }
+
+    for (int ch = 0; ch < TRIGGER_MAX_CHANNELS; ch++)
+        pos[ch] = t->ch[ch].tail;
+
+    while (1)
+    {
+        int oldest = -1;
+        uint64_t oldest_ts = 0;
+
+        for (int ch = 0; ch < TRIGGER_MAX_CHANNELS; ch++)
+        {
+            if ((t->ch[ch].buf == NULL) || (pos[ch] >= t->ch[ch].head))
+                continue;
+
+            ring_copy_out(t, &t->ch[ch], pos[ch], &rec, sizeof(rec));
+            if ((oldest < 0) || (rec.timestamp_ns < oldest_ts))
+            {
+                oldest = ch;
+                oldest_ts = rec.timestamp_ns;
+            }
+        }
+
+        if (oldest < 0)
+            break;
+
+        ring_copy_out(t, &t->ch[oldest], pos[oldest], &rec, sizeof(rec));
+        ring_copy_out(t, &t->ch[oldest], pos[oldest] + sizeof(rec), payload, rec.length);
+        pos[oldest] += sizeof(rec) + rec.length;
+        capture_write(&t->out, rec.timestamp_ns, rec.probe, rec.channel, rec.type, payload, rec.length);
+    }
+    free(payload);
+
+    capture_write(&t->out, timestamp_ns, 0, 0, CAPTURE_REC_TRIGGER, (const uint8_t *)reason, strlen(reason));
+    capture_commit(&t->out);
+
+    /* what was dumped is not kept for the next trigger */
+    for (int ch = 0; ch < TRIGGER_MAX_CHANNELS; ch++)
+        t->ch[ch].tail = t->ch[ch].head;
+
+    t->post_left = t->post;
+    if (t->post_left == 0)
+        capture_close(&t->out);
+}
+
+void trigger_commit(trigger_t *t)
+{
+    if (t->post_left > 0)
+        capture_commit(&t->out);
+}
+
+void trigger_close(trigger_t *t)
+{
+    if (!t->active)
+        return;
+
+    capture_close(&t->out);
+    for (int ch = 0; ch < TRIGGER_MAX_CHANNELS; ch++)
+        free(t->ch[ch].buf);
+    if (t->has_pattern)
+        match_free(&t->pattern);
+    if (t->has_regex)
+        regfree(&t->regex);
+    memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,53 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include <stdint.h>
+#include <regex.h>
+
+#include "capture.h"
+#include "match.h"
+
+/* Pre-trigger capture: the last ring_size bytes of every up channel are kept in memory as framed
+ * records, nothing touches the disk until a trigger fires. Then the rings are written (merged by
+ * timestamp) into <prefix>-NNNN.bin, a capture file, followed by a CAPTURE_REC_TRIGGER record and
+ * the next post bytes of live data. */
+
+#define TRIGGER_MAX_CHANNELS 256 // any capture channel id (RTT up channels and SWO ports), rings are allocated on first use
+#define TRIGGER_LINE_MAX 512
+
+typedef struct
+{
+    uint8_t *buf;
+    uint64_t head; // logical positions, like the flight recorder
+    uint64_t tail;
+    uint32_t match_state;
+    char line[TRIGGER_LINE_MAX + 1]; // current line, for the regex trigger
+    uint32_t line_len;
+} trigger_ring_t;
+
+typedef struct
+{
+    trigger_ring_t ch[TRIGGER_MAX_CHANNELS];
+    uint32_t ring_size;
+    uint32_t post;      // bytes of live data written after the trigger
+    const char *prefix; // dump file prefix
+    match_t pattern;
+    int has_pattern;
+    regex_t regex;
+    int has_regex;
+    int on_reset;       // fire when the target resets (DHCSR S_RESET_ST seen by the poll loop)
+    uint32_t post_left; // a dump is open while this is non-zero
+    uint32_t dumps;
+    capture_writer_t out;
+    int active;
+} trigger_t;
+
+int trigger_init(trigger_t *t, const char *prefix, uint32_t ring_size, uint32_t post);
+int trigger_set_pattern(trigger_t *t, const char *escaped);
+int trigger_set_regex(trigger_t *t, const char *re);
+void trigger_data(trigger_t *t, uint64_t timestamp_ns, uint16_t probe, uint8_t channel, const uint8_t *buf, uint32_t len);
+void trigger_fire(trigger_t *t, uint64_t timestamp_ns, const char *reason);
+void trigger_commit(trigger_t *t);
+void trigger_close(trigger_t *t);
+
+#endif
@@ -0,0 +1,280 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "usbpipe.h"
+
+/* First byte of a status answer when the last command succeeded (STLINK_DEBUG_ERR_OK, private to the library) */
+#define USBPIPE_STATUS_OK 0x80
+
+struct usbpipe_slot
+{
+    usbpipe_t *up;
+    struct libusb_transfer *cmd;  // command block, OUT
+    struct libusb_transfer *data; // answer (IN) or data to write (OUT)
+    uint8_t cmd_buf[STLINK_CMD_SIZE];
+    uint8_t status_buf[12]; // answer of a status command
+    int status;
+    int pending; // transfers not completed yet
+    int failed;
+};
+
+static void usbpipe_advance(usbpipe_t *up);
+
+static void LIBUSB_CALL usbpipe_done(struct libusb_transfer *t)
+{
+    usbpipe_slot_t *s = t->user_data;
+
+    if ((t->status != LIBUSB_TRANSFER_COMPLETED) || (t->actual_length != t->length))
+        s->failed = 1;
+    else if (s->status && (t == s->data) && (s->status_buf[0] != USBPIPE_STATUS_OK))
+        s->failed = 1;
+    s->pending--;
+    if (s->pending == 0)
+        usbpipe_advance(s->up);
+}
+
+int usbpipe_open(usbpipe_t *up, stlink_t *sl, int depth)
+{
+    struct stlink_libusb *slu = sl->backend_data;
+
+    memset(up, 0, sizeof(*up));
+    /* V1 talks SCSI pass-through, nothing to pipeline */
+    if ((depth < 2) || (sl->version.stlink_v < 2) || (slu == NULL) || (slu->protocoll != 0))
+        return -1;
+    if (depth > USBPIPE_DEPTH)
+        depth = USBPIPE_DEPTH;
+
+    up->ctx = slu->libusb_ctx;
+    up->handle = slu->usb_handle;
+    up->ep_req = slu->ep_req;
+    up->ep_rep = slu->ep_rep;
+    up->cmd_len = slu->cmd_len;
+    if (sl->version.jtag_api != STLINK_JTAG_API_V1)
+    {
+        up->status_cmd = (sl->version.flags & STLINK_F_HAS_GETLASTRWSTATUS2) ? STLINK_DEBUG_APIV2_GETLASTRWSTATUS2
+                                                                             : STLINK_DEBUG_APIV2_GETLASTRWSTATUS;
+        up->status_len = (sl->version.flags & STLINK_F_HAS_GETLASTRWSTATUS2) ? 12 : 2;
+    }
+    up->depth = depth;
+    up->slot = calloc(depth, sizeof(usbpipe_slot_t));
+    if (up->slot == NULL)
+        return -1;
+
+    for (int i = 0; i < depth; i++)
+    {
+        up->slot[i].up = up;
+        up->slot[i].cmd = libusb_alloc_transfer(0);
+        up->slot[i].data = libusb_alloc_transfer(0);
+        if ((up->slot[i].cmd == NULL) || (up->slot[i].data == NULL))
+        {
+            usbpipe_close(up);
+            return -1;
+        }
+    }
+    up->active = 1;
+    return 0;
+}
+
+static int usbpipe_submit(usbpipe_t *up, usbpipe_slot_t *s, const usbpipe_op_t *op)
+{
+    uint8_t *cmd = s->cmd_buf;
+
+    memset(cmd, 0, sizeof(s->cmd_buf));
+    cmd[0] = STLINK_DEBUG_COMMAND;
+    if (op->status)
+    {
+        cmd[1] = up->status_cmd;
+        libusb_fill_bulk_transfer(s->data, up->handle, up->ep_rep, s->status_buf, up->status_len, usbpipe_done, s,
+                                  USBPIPE_TIMEOUT_MS);
+    }
+    else
+    {
+        cmd[1] = op->write ? STLINK_DEBUG_WRITEMEM_32BIT : STLINK_DEBUG_READMEM_32BIT;
+        cmd[2] = op->addr;
+        cmd[3] = op->addr >> 8;
+        cmd[4] = op->addr >> 16;
+        cmd[5] = op->addr >> 24;
+        cmd[6] = op->len;
+        cmd[7] = op->len >> 8;
+        libusb_fill_bulk_transfer(s->data, up->handle, op->write ? up->ep_req : up->ep_rep, op->buf, op->len,
+                                  usbpipe_done, s, USBPIPE_TIMEOUT_MS);
+    }
+    libusb_fill_bulk_transfer(s->cmd, up->handle, up->ep_req, cmd, up->cmd_len, usbpipe_done, s, USBPIPE_TIMEOUT_MS);
+    s->status = op->status;
+    s->failed = 0;
+    s->pending = 0;
+
+    if (libusb_submit_transfer(s->cmd) != 0)
+        return -1;
+    s->pending++;
+    if (libusb_submit_transfer(s->data) != 0)
+    {
+        /* the probe has a command without its data phase, the session is lost anyway */
+        s->failed = 1;
+        return 0;
+    }
+    s->pending++;
+    return 0;
+}
+
+/* Cancel the commands still in flight after a failure, their callbacks still have to run */
+static void usbpipe_cancel(usbpipe_t *up, int from, int to)
+{
+    for (int i = from; i < to; i++)
+    {
+        usbpipe_slot_t *s = &up->slot[i % up->depth];
+
+        if (s->pending > 0)
+        {
+            libusb_cancel_transfer(s->cmd);
+            libusb_cancel_transfer(s->data);
+        }
+    }
+}
+
+static int usbpipe_queue(usbpipe_t *up, uint32_t addr, uint32_t len, uint8_t *buf, int write, int status)
+{
+    if (up->count == up->op_size)
+    {
+        int size = up->op_size ? up->op_size * 2 : 64;
+        usbpipe_op_t *grown = realloc(up->op, size * sizeof(usbpipe_op_t));
+
+        if (grown == NULL)
+        {
+            up->count = 0;
+            return -1;
+        }
+        up->op = grown;
+        up->op_size = size;
+    }
+    up->op[up->count].addr = addr;
+    up->op[up->count].len = len;
+    up->op[up->count].buf = buf;
+    up->op[up->count].write = write;
+    up->op[up->count].status = status;
+    up->count++;
+    return 0;
+}
+
+int usbpipe_add(usbpipe_t *up, uint32_t addr, uint32_t len, uint8_t *buf, int write)
+{
+    if (usbpipe_queue(up, addr, len, buf, write, 0) != 0)
+        return -1;
+    /* the write command has no answer of its own, the probe tells afterwards if the target took it */
+    if (write && (up->status_len > 0))
+        return usbpipe_queue(up, 0, 0, NULL, 0, 1);
+    return 0;
+}
+
+/* Keep the pipe full, the slots are used in turn and complete in order */
+static void usbpipe_fill(usbpipe_t *up)
+{
+    while (!up->err && (up->next < up->count) && (up->next - up->done < up->depth))
+    {
+        if (usbpipe_submit(up, &up->slot[up->next % up->depth], &up->op[up->next]) != 0)
+        {
+            up->err = -1;
+            usbpipe_cancel(up, up->done, up->next);
+            return;
+        }
+        up->next++;
+        up->commands++;
+    }
+}
+
+/* A slot completed: retire the finished commands, submit the next ones, end the batch when all is over */
+static void usbpipe_advance(usbpipe_t *up)
+{
+    while ((up->done < up->next) && (up->slot[up->done % up->depth].pending == 0))
+    {
+        if (up->slot[up->done % up->depth].failed && !up->err)
+        {
+            up->err = -1;
+            usbpipe_cancel(up, up->done + 1, up->next);
+        }
+        up->done++;
+    }
+    usbpipe_fill(up);
+
+    if (up->busy && (up->done == up->next) && (up->err || (up->next == up->count)))
+    {
+        up->busy = 0;
+        up->count = 0;
+        if (up->cb)
+            up->cb(up->cb_ctx, up->err);
+    }
+}
+
+void usbpipe_start(usbpipe_t *up, usbpipe_done_t cb, void *ctx)
+{
+    up->cb = cb;
+    up->cb_ctx = ctx;
+    up->next = 0;
+    up->done = 0;
+    up->err = 0;
+    up->busy = 1;
+    up->batches++;
+    usbpipe_advance(up); /* ends here when nothing could be submitted */
+}
+
+int usbpipe_wait(usbpipe_t *up)
+{
+    while (up->busy)
+    {
+        struct timeval tv = {1, 0};
+
+        if ((libusb_handle_events_timeout_completed(up->ctx, &tv, NULL) < 0) && !up->err)
+        {
+            up->err = -1;
+            usbpipe_cancel(up, up->done, up->next);
+        }
+    }
+    return up->err;
+}
+
+int usbpipe_run(usbpipe_t *up)
+{
+    usbpipe_start(up, NULL, NULL);
+    return usbpipe_wait(up);
+}
+
+const struct libusb_pollfd **usbpipe_pollfds(usbpipe_t *up)
+{
+    return libusb_get_pollfds(up->ctx);
+}
+
+void usbpipe_events(usbpipe_t *up)
+{
+    struct timeval tv = {0, 0};
+
+    if ((libusb_handle_events_timeout_completed(up->ctx, &tv, NULL) < 0) && up->busy && !up->err)
+    {
+        up->err = -1;
+        usbpipe_cancel(up, up->done, up->next);
+    }
+}
+
+void usbpipe_close(usbpipe_t *up)
+{
+    if (up->busy)
+    {
+        up->cb = NULL;
+        up->err = -1;
+        usbpipe_cancel(up, up->done, up->next);
+        usbpipe_wait(up);
+    }
+    if (up->slot)
+    {
+        for (int i = 0; i < up->depth; i++)
+        {
+            libusb_free_transfer(up->slot[i].cmd); /* NULL is allowed */
+            libusb_free_transfer(up->slot[i].data);
+        }
+        free(up->slot);
+    }
+    free(up->op);
+    memset(up, 0, sizeof(*up));
+}
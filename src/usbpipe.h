@@ -0,0 +1,79 @@
+#ifndef USBPIPE_H
+#define USBPIPE_H
+
+#include <stdint.h>
+
+#include <stlink.h>
+
+/* Pipelined 32 bit memory transfers: the ST-Link commands are built here and queued as asynchronous
+ * libusb transfers on the probe endpoints, up to USBPIPE_DEPTH commands in flight, instead of one
+ * blocking round trip per stlink_read_mem32() / stlink_write_mem32(). The probe executes them in order,
+ * the host controller keeps its endpoints busy while the previous answers are being collected.
+ * Only for V2/V3 probes on the libusb backend, the rest keeps the blocking library calls.
+ * Every write is followed by a last read/write status command, as the library does, a write the target
+ * refused fails the batch.
+ *
+ * A batch is queued with usbpipe_add(), then either run to completion (usbpipe_run()) or started
+ * (usbpipe_start()) and completed from the libusb events of the probe context, e.g. by an event loop
+ * polling the usbpipe_pollfds() of several probes (see reactor.h). */
+
+#define USBPIPE_DEPTH 8
+#define USBPIPE_TIMEOUT_MS 3000 /* same as the library */
+
+typedef struct
+{
+    uint32_t addr; // 4 byte aligned
+    uint32_t len;  // multiple of 4, within one TAR block (see xfer.h)
+    uint8_t *buf;  // read destination or write source
+    int write;
+    int status; // last read/write status command, after a write (addr, len and buf unused)
+} usbpipe_op_t;
+
+typedef struct usbpipe_slot usbpipe_slot_t;
+
+/* End of a started batch, err = 0 or -1, called from the libusb event handling */
+typedef void (*usbpipe_done_t)(void *ctx, int err);
+
+typedef struct usbpipe
+{
+    libusb_context *ctx;
+    libusb_device_handle *handle;
+    uint8_t ep_req, ep_rep;
+    uint32_t cmd_len;
+    uint32_t status_len; // answer of the status command, 0 = not available (JTAG API V1)
+    uint8_t status_cmd;
+    int depth;
+    usbpipe_slot_t *slot;
+    usbpipe_op_t *op; // queued batch
+    int op_size;
+    int count;     // operations in the batch
+    int next;      // next one to submit
+    int done;      // completed ones, in order
+    int err;
+    volatile int busy;
+    usbpipe_done_t cb;
+    void *cb_ctx;
+    uint64_t batches;
+    uint64_t commands;
+    int active;
+} usbpipe_t;
+
+/* depth = commands in flight (2..USBPIPE_DEPTH), returns -1 when the probe can't be driven this way */
+int usbpipe_open(usbpipe_t *up, stlink_t *sl, int depth);
+/* Queue one operation in the next batch (and the status check of a write), returns -1 when out of
+ * memory (the batch is dropped) */
+int usbpipe_add(usbpipe_t *up, uint32_t addr, uint32_t len, uint8_t *buf, int write);
+/* Start the queued batch, cb is called once every operation completed, or after the first failure
+ * (the remaining ones are cancelled); the buffers must stay valid until then */
+void usbpipe_start(usbpipe_t *up, usbpipe_done_t cb, void *ctx);
+/* Handle the probe events until the started batch is over, returns its result */
+int usbpipe_wait(usbpipe_t *up);
+/* Start and wait */
+int usbpipe_run(usbpipe_t *up);
+/* File descriptors to watch for the batch in flight, NULL terminated, to be freed with libusb_free_pollfds() */
+const struct libusb_pollfd **usbpipe_pollfds(usbpipe_t *up);
+/* Handle the events that are ready without waiting, after one of the pollfds woke up or timed out */
+void usbpipe_events(usbpipe_t *up);
+void usbpipe_close(usbpipe_t *up);
+
+#endif
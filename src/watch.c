@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "watch.h"
+#include "timebase.h"
+
+static const char *const watch_type_names[] = {"u8", "i8", "u16", "i16", "u32", "i32", "f32"};
+static const uint8_t watch_type_size[] = {1, 1, 2, 2, 4, 4, 4};
+
+void watch_init(watch_t *w)
+{
+    memset(w, 0, sizeof(*w));
+    readplan_init(&w->plan);
+}
+
+int watch_add(watch_t *w, const char *spec, const elf_symbols_t *elf)
+{
+    char name[WATCH_NAME_MAX];
+    const char *colon = strchr(spec, ':');
+    size_t name_len = colon ? (size_t)(colon - spec) : strlen(spec);
+    watch_var_t *v;
+
+    if ((w->count >= WATCH_MAX_VARS) || (name_len == 0) || (name_len >= WATCH_NAME_MAX))
+        return -1;
+
+    v = &w->vars[w->count];
+    memcpy(name, spec, name_len);
+    name[name_len] = 0;
+    strcpy(v->name, name);
+    v->type = WATCH_U32;
+
+    if (isdigit((unsigned char)name[0]))
+    {
+        v->addr = strtoul(name, NULL, 0);
+    }
+    else
+    {
+        const elf_symbol_t *sym = elf ? elf_find_name(elf, name) : NULL;
+
+        if ((sym == NULL) || (sym->type != ELF_SYM_OBJECT))
+            return -1;
+        v->addr = sym->addr;
+        if (sym->size == 1)
+            v->type = WATCH_U8;
+        else if (sym->size == 2)
+            v->type = WATCH_U16;
+    }
+
+    if (colon)
+    {
+        int t;
+
+        for (t = 0; t <= WATCH_F32; t++)
+        {
+            if (strcmp(colon + 1, watch_type_names[t]) == 0)
+                break;
+        }
+        if (t > WATCH_F32)
+            return -1;
+        v->type = t;
+    }
+
+    w->count++;
+    return 0;
+}
+
+int watch_open(watch_t *w, const char *path, uint32_t rate_hz)
+{
+    size_t len = strlen(path);
+
+    if ((w->count == 0) || (rate_hz == 0))
+        return -1;
+
+    w->out = fopen(path, "wb");
+    if (w->out == NULL)
+        return -1;
+
+    w->csv = (len > 4) && (strcmp(path + len - 4, ".csv") == 0);
+    if (w->csv)
+    {
+        fprintf(w->out, "time_s");
+        for (int i = 0; i < w->count; i++)
+            fprintf(w->out, ",%s", w->vars[i].name);
+        fprintf(w->out, "\n");
+    }
+    else
+    {
+        watch_file_header_t hdr = {.magic = "YRTTVAR", .version = 1, .count = w->count};
+
+        fwrite(&hdr, sizeof(hdr), 1, w->out);
+        for (int i = 0; i < w->count; i++)
+        {
+            watch_file_var_t fv = {.addr = w->vars[i].addr, .type = w->vars[i].type};
+
+            strcpy(fv.name, w->vars[i].name); /* shorter than WATCH_NAME_MAX, the rest stays zeroed */
+            fwrite(&fv, sizeof(fv), 1, w->out);
+        }
+    }
+
+    w->period_ns = 1000000000ull / rate_hz;
+    w->start_ns = timebase_now_ns();
+    w->next_ns = w->start_ns;
+    w->active = 1;
+    return 0;
+}
+
+static void watch_write_value(watch_t *w, const watch_var_t *v)
+{
+    const uint8_t *r = v->raw;
+    uint32_t u32 = r[0] | (r[1] << 8) | (r[2] << 16) | ((uint32_t)r[3] << 24);
+    float f;
+
+    switch (v->type)
+    {
+    case WATCH_U8:
+        fprintf(w->out, ",%u", r[0]);
+        break;
+    case WATCH_I8:
+        fprintf(w->out, ",%d", (int8_t)r[0]);
+        break;
+    case WATCH_U16:
+        fprintf(w->out, ",%u", (uint16_t)u32);
+        break;
+    case WATCH_I16:
+        fprintf(w->out, ",%d", (int16_t)u32);
+        break;
+    case WATCH_U32:
+        fprintf(w->out, ",%u", u32);
+        break;
+    case WATCH_I32:
+        fprintf(w->out, ",%d", (int32_t)u32);
+        break;
+    default:
+        memcpy(&f, &u32, sizeof(f));
+        fprintf(w->out, ",%.9g", f);
+        break;
+    }
+}
+
+int watch_sample(watch_t *w, stlink_t *sl, const xfer_caps_t *caps, uint64_t now)
+{
+    uint64_t t0, ts;
+
+    if (!w->active || (now < w->next_ns))
+        return 0;
+
+    for (int i = 0; i < w->count; i++)
+        readplan_add(&w->plan, w->vars[i].addr, watch_type_size[w->vars[i].type], w->vars[i].raw);
+
+    t0 = timebase_now_ns();
+    if (readplan_run(&w->plan, sl, caps) != 0)
+        return -1;
+    ts = t0 + (timebase_now_ns() - t0) / 2;
+
+    if (w->csv)
+    {
+        fprintf(w->out, "%.9f", (ts - w->start_ns) / 1e9);
+        for (int i = 0; i < w->count; i++)
+            watch_write_value(w, &w->vars[i]);
+        fprintf(w->out, "\n");
+    }
+    else
+    {
+        fwrite(&ts, sizeof(ts), 1, w->out);
+        for (int i = 0; i < w->count; i++)
+            fwrite(w->vars[i].raw, watch_type_size[w->vars[i].type], 1, w->out);
+    }
+    w->samples++;
+
+    /* keep the sampling grid, skip the slots that already passed */
+    w->next_ns += w->period_ns;
+    if (w->next_ns <= now)
+    {
+        uint64_t late = (now - w->next_ns) / w->period_ns + 1;
+
+        w->missed += late;
+        w->next_ns += late * w->period_ns;
+    }
+    return 0;
+}
+
+void watch_close(watch_t *w)
+{
+    if (w->out)
+        fclose(w->out);
+    w->out = NULL;
+    readplan_free(&w->plan);
+    w->active = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <stlink.h>
+
+#include "elf_symbols.h"
+#include "readplan.h"
+
+/* Variable sampling: a list of target variables (address or ELF symbol, with a type) is read at a fixed
+ * rate in the idle time between RTT polls, all of them in one batched read plan, and written as
+ *   CSV     time_s,<name>,...   (output file ending in .csv)
+ *   binary  watch_file_header_t, count watch_file_var_t, then one record per sample:
+ *           uint64_t host monotonic ns followed by the raw little endian values, packed, in list order */
+
+#define WATCH_MAX_VARS 32
+#define WATCH_NAME_MAX 32
+
+#define WATCH_U8 0
+#define WATCH_I8 1
+#define WATCH_U16 2
+#define WATCH_I16 3
+#define WATCH_U32 4
+#define WATCH_I32 5
+#define WATCH_F32 6
+
+typedef struct
+{
+    char magic[8]; // "YRTTVAR"
+    uint32_t version;
+    uint32_t count;
+} watch_file_header_t;
+
+typedef struct
+{
+    char name[WATCH_NAME_MAX];
+    uint32_t addr;
+    uint32_t type; // WATCH_xxx
+} watch_file_var_t;
+
+typedef struct
+{
+    char name[WATCH_NAME_MAX];
+    uint32_t addr;
+    int type;
+    uint8_t raw[4];
+} watch_var_t;
+
+typedef struct
+{
+    watch_var_t vars[WATCH_MAX_VARS];
+    int count;
+    readplan_t plan;
+    FILE *out;
+    int csv;
+    uint64_t period_ns;
+    uint64_t next_ns; // time of the next sample
+    uint64_t start_ns;
+    uint64_t samples;
+    uint64_t missed; // sample times skipped because the probe was busy or too slow
+    int active;
+} watch_t;
+
+void watch_init(watch_t *w);
+/* spec = NAME[:TYPE] or ADDR[:TYPE], TYPE one of u8 i8 u16 i16 u32 i32 f32, by default from the symbol
+ * size (u32 for addresses); elf = symbols for the names, may be NULL */
+int watch_add(watch_t *w, const char *spec, const elf_symbols_t *elf);
+int watch_open(watch_t *w, const char *path, uint32_t rate_hz);
+/* Take the sample due at or before now, returns -1 when the read failed */
+int watch_sample(watch_t *w, stlink_t *sl, const xfer_caps_t *caps, uint64_t now);
+void watch_close(watch_t *w);
+
+#endif
@@ -0,0 +1,196 @@
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "usbpipe.h"
+#include "xfer.h"
+
+void xfer_caps(xfer_caps_t *caps, const stlink_t *sl, uint32_t swd_khz)
+{
+    caps->rw8_max = (sl->version.flags & STLINK_F_HAS_RW8_512BYTES) ? XFER_RW8_MAX_512 : XFER_RW8_MAX;
+    caps->rw32_max = XFER_TAR_BLOCK;
+    caps->overhead_ns = (sl->version.stlink_v >= 3) ? XFER_OVERHEAD_NS_V3 : XFER_OVERHEAD_NS_V2;
+    if (swd_khz == 0)
+        swd_khz = XFER_DEFAULT_SWD_KHZ;
+    caps->byte_ns = XFER_SWD_CLOCKS_PER_BYTE * 1000000u / swd_khz;
+}
+
+/* Largest 32 bit transfer starting at addr (aligned) for at most len bytes */
+static uint32_t xfer_chunk32(const xfer_caps_t *caps, uint32_t addr, uint32_t len)
+{
+    uint32_t n = XFER_TAR_BLOCK - (addr % XFER_TAR_BLOCK);
+
+    if (n > caps->rw32_max)
+        n = caps->rw32_max;
+    if (n > len)
+        n = len;
+    return n;
+}
+
+/* addr, len = any alignment, the read is widened to whole words */
+int xfer_read(stlink_t *sl, const xfer_caps_t *caps, uint32_t addr, uint8_t *buf, uint32_t len)
+{
+    uint32_t start = addr & ~3u;
+    uint32_t end = (addr + len + 3) & ~3u;
+
+    while (start < end)
+    {
+        uint32_t n = xfer_chunk32(caps, start, end - start);
+        uint32_t skip = (addr > start) ? addr - start : 0;
+        uint32_t copy = n - skip;
+
+        if (stlink_read_mem32(sl, start, n) != 0)
+            return -1;
+        if (copy > len)
+            copy = len;
+        memcpy(buf, sl->q_buf + skip, copy);
+        buf += copy;
+        len -= copy;
+        addr += copy;
+        start += n;
+    }
+    return 0;
+}
+
+static int xfer_write8(stlink_t *sl, const xfer_caps_t *caps, uint32_t addr, const uint8_t *buf, uint32_t len)
+{
+    while (len > 0)
+    {
+        uint32_t n = (len > caps->rw8_max) ? caps->rw8_max : len;
+
+        memcpy(sl->q_buf, buf, n);
+        if (stlink_write_mem8(sl, addr, n) != 0)
+            return -1;
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int xfer_write(stlink_t *sl, const xfer_caps_t *caps, uint32_t addr, const uint8_t *buf, uint32_t len)
+{
+    uint32_t head = (4 - (addr % 4)) % 4, body;
+
+    /* an aligned word is always written with a 32 bit access: the target may read a word (RdOff,
+     * WrOff) at any time and the 8 bit path would let it see half of an update */
+    if (head > len)
+        head = len;
+    if (((len - head) & ~3u) == 0)
+        return xfer_write8(sl, caps, addr, buf, len);
+
+    if ((head > 0) && (xfer_write8(sl, caps, addr, buf, head) != 0))
+        return -1;
+    addr += head;
+    buf += head;
+    len -= head;
+
+    body = len & ~3u;
+    while (body > 0)
+    {
+        uint32_t n = xfer_chunk32(caps, addr, body);
+
+        memcpy(sl->q_buf, buf, n);
+        if (stlink_write_mem32(sl, addr, n) != 0)
+            return -1;
+        addr += n;
+        buf += n;
+        len -= n;
+        body -= n;
+    }
+
+    return (len > 0) ? xfer_write8(sl, caps, addr, buf, len) : 0;
+}
+
+/* Queue one aligned transfer in 32 bit commands */
+static int xfer_queue(const xfer_caps_t *caps, const xfer_iov_t *iov, int write)
+{
+    uint32_t addr = iov->addr, len = iov->len;
+    uint8_t *buf = iov->buf;
+
+    while (len > 0)
+    {
+        uint32_t n = xfer_chunk32(caps, addr, len);
+
+        if (usbpipe_add(caps->pipe, addr, n, buf, write) != 0)
+            return -1;
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int xfer_pipelined(const xfer_caps_t *caps, const xfer_iov_t *iov)
+{
+    return (caps->pipe != NULL) && (iov->addr % 4 == 0) && (iov->len % 4 == 0);
+}
+
+static int xfer_vector(stlink_t *sl, const xfer_caps_t *caps, const xfer_iov_t *iov, int count, int write)
+{
+    int queued = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (xfer_pipelined(caps, &iov[i]))
+        {
+            if (xfer_queue(caps, &iov[i], write) != 0)
+                return -1;
+            queued = 1;
+            continue;
+        }
+
+        /* the blocking calls use the same endpoints, what is queued goes first */
+        if (queued)
+        {
+            if (usbpipe_run(caps->pipe) != 0)
+                return -1;
+            queued = 0;
+        }
+        if ((write ? xfer_write(sl, caps, iov[i].addr, iov[i].buf, iov[i].len)
+                   : xfer_read(sl, caps, iov[i].addr, iov[i].buf, iov[i].len)) != 0)
+            return -1;
+    }
+    return queued ? usbpipe_run(caps->pipe) : 0;
+}
+
+int xfer_readv(stlink_t *sl, const xfer_caps_t *caps, const xfer_iov_t *iov, int count)
+{
+    return xfer_vector(sl, caps, iov, count, 0);
+}
+
+int xfer_writev(stlink_t *sl, const xfer_caps_t *caps, const xfer_iov_t *iov, int count)
+{
+    return xfer_vector(sl, caps, iov, count, 1);
+}
+
+void xfer_start(stlink_t *sl, const xfer_caps_t *caps, const xfer_iov_t *iov, int count, int write, xfer_done_t done,
+                void *ctx)
+{
+    int async = (caps->pipe != NULL);
+
+    for (int i = 0; async && (i < count); i++)
+        async = xfer_pipelined(caps, &iov[i]);
+
+    if (!async)
+    {
+        done(ctx, xfer_vector(sl, caps, iov, count, write));
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (xfer_queue(caps, &iov[i], write) != 0)
+        {
+            done(ctx, -1);
+            return;
+        }
+    }
+    usbpipe_start(caps->pipe, done, ctx);
+}
+
+void xfer_wait(const xfer_caps_t *caps)
+{
+    if (caps->pipe != NULL)
+        usbpipe_wait(caps->pipe);
+}
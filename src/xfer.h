@@ -0,0 +1,68 @@
+#ifndef XFER_H
+#define XFER_H
+
+#include <stdint.h>
+
+#include <stlink.h>
+
+/* Transfer planner: every target memory access goes through here and is split according to what the
+ * connected probe can do in one USB command.
+ *  - 32 bit transfers are limited by the TAR auto-increment range (1 KB is the only size guaranteed by
+ *    the ADI spec), a transfer never crosses such a boundary
+ *  - 8 bit transfers are limited to 64 bytes, 512 on probes reporting STLINK_F_HAS_RW8_512BYTES (V3 and
+ *    recent V2 firmwares)
+ * Reads are always done as aligned 32 bit transfers. Writes are split into an unaligned 8 bit head,
+ * 32 bit body and 8 bit tail, so that every whole aligned word is written at once; only writes that
+ * contain no aligned word go through a single 8 bit transfer.
+ * With a USB pipeline (usbpipe.h) attached to the caps, the 32 bit transfers of xfer_readv() /
+ * xfer_writev() are queued together and run with several commands in flight. */
+
+#define XFER_TAR_BLOCK 1024
+#define XFER_RW8_MAX 64
+#define XFER_RW8_MAX_512 512
+
+/* Cost model for the read planner: fixed round trip of one command (full speed USB on V1/V2, high speed
+ * on V3) and time per byte on the SWD wire, about 12 clocks per byte with the protocol overhead */
+#define XFER_OVERHEAD_NS_V2 1000000
+#define XFER_OVERHEAD_NS_V3 150000
+#define XFER_SWD_CLOCKS_PER_BYTE 12
+#define XFER_DEFAULT_SWD_KHZ 1800
+
+struct usbpipe;
+
+typedef struct
+{
+    uint32_t rw8_max;  // bytes per stlink_write_mem8
+    uint32_t rw32_max; // bytes per stlink_read_mem32 / stlink_write_mem32, multiple of 4
+    uint32_t overhead_ns; // cost of one transaction
+    uint32_t byte_ns;     // cost of one more byte in a transaction
+    struct usbpipe *pipe; // asynchronous transfers, NULL = blocking library calls (not set by xfer_caps())
+} xfer_caps_t;
+
+typedef struct
+{
+    uint32_t addr;
+    uint32_t len;
+    uint8_t *buf; // not modified by xfer_writev()
+} xfer_iov_t;
+
+/* Limits of the probe behind sl, to be refreshed on every new connection (swd_khz = SWD clock, 0 if unknown) */
+void xfer_caps(xfer_caps_t *caps, const stlink_t *sl, uint32_t swd_khz);
+int xfer_read(stlink_t *sl, const xfer_caps_t *caps, uint32_t addr, uint8_t *buf, uint32_t len);
+int xfer_write(stlink_t *sl, const xfer_caps_t *caps, uint32_t addr, const uint8_t *buf, uint32_t len);
+/* Several transfers at once, in order: the word aligned ones are pipelined when caps->pipe is set,
+ * the others go through xfer_read() / xfer_write() */
+int xfer_readv(stlink_t *sl, const xfer_caps_t *caps, const xfer_iov_t *iov, int count);
+int xfer_writev(stlink_t *sl, const xfer_caps_t *caps, const xfer_iov_t *iov, int count);
+
+/* End of xfer_start(), err = 0 or -1 */
+typedef void (*xfer_done_t)(void *ctx, int err);
+/* Same without waiting when all the transfers can be pipelined: done is called from the probe events
+ * (xfer_wait(), or an event loop on the pipe, see reactor.h), otherwise everything runs blocking and
+ * done is called before returning. The buffers must stay valid until done */
+void xfer_start(stlink_t *sl, const xfer_caps_t *caps, const xfer_iov_t *iov, int count, int write, xfer_done_t done,
+                void *ctx);
+/* Wait for the end of what xfer_start() left in flight */
+void xfer_wait(const xfer_caps_t *caps);
+
+#endif
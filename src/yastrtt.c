@@ -5,205 +5,465 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <math.h>
 #include <unistd.h>
 #include <signal.h>
 #include <time.h>
 #include <termios.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <netdb.h>
 
 #include <stlink.h>
 
-typedef struct
-{
-    uint32_t sName;        // Optional name. Standard names so far are: "Terminal", "SysView", "J-Scope_t4i4"
-    uint32_t pBuffer;      // Pointer to start of buffer
-    uint32_t SizeOfBuffer; // Buffer size in bytes. Note that one byte is lost, as this implementation does not fill up the buffer in order to avoid the problem of being unable to distinguish between full and empty.
-    uint32_t WrOff;        // Position of next item to be written by either target.
-    uint32_t RdOff;        // Position of next item to be read by host. Must be volatile since it may be modified by host.
-    uint32_t Flags;        // Contains configuration flags
-} rtt_channel;
-
-typedef struct
-{
-    int8_t acID[16];           // Initialized to "SEGGER RTT"
-    int32_t MaxNumUpBuffers;   // Initialized to SEGGER_RTT_MAX_NUM_UP_BUFFERS (type. 2)
-    int32_t MaxNumDownBuffers; // Initialized to SEGGER_RTT_MAX_NUM_DOWN_BUFFERS (type. 2)
-    int32_t cb_size;
-    int32_t cb_addr;
-    rtt_channel *aUp;   // Up buffers, transferring information up from target via debug probe to host
-    rtt_channel *aDown; // Down buffers, transferring information down from host via debug probe to target
-} rtt_cb_t;
-
-stlink_t *sl = NULL;
-rtt_cb_t rtt_cb = {0};
-
-int capt_signal = 0;
+#include "capture.h"
+#include "capture_index.h"
+#include "flight.h"
+#include "trigger.h"
+#include "filter.h"
+#include "linestamp.h"
+#include "clocksync.h"
+#include "profiler.h"
+#include "swo.h"
+#include "swdclk.h"
+#include "xfer.h"
+#include "readplan.h"
+#include "watch.h"
+#include "jscope.h"
+#include "sysview.h"
+#include "deflog.h"
+#include "frame.h"
+#include "plugin.h"
+#include "rtt.h"
+#include "reactor.h"
+#include "status.h"
+#include "ioq.h"
+#include "pool.h"
+
+#define DHCSR 0xE000EDF0
+#define DHCSR_S_RESET_ST (1 << 25) /* sticky, the core has been reset since the last DHCSR read */
+#include "timebase.h"
+
+/* Time between two reads of the SystemView channel, it can produce far more than the RTT buffer holds
+ * in one POLL_INTERVAL_US */
+#define SYSVIEW_POLL_US 1000
+
+/* Longest frame shown in hex on the terminal */
+#define FRAME_HEX_MAX 64
+
+/* Time between two polls of the target */
+#define POLL_INTERVAL_US 100000
+
+/* Time between two reads of the SWO trace, the probe only buffers a few ms of it */
+#define SWO_POLL_US 2000
+
+/* Time between two polls of one board in --rack mode */
+#define RACK_POLL_US 10000
+#define RACK_USB_DEPTH 4 /* the rack event loop needs transfers in flight, see reactor.h */
+
+/* Data waiting for the worker pool before the output thread waits */
+#define POOL_PENDING_MAX (32u * 1024u * 1024u)
+
+/* Records of the output queue, see ioq.h */
+#define OUTQ_DATA 0  /* drained channel data, avail = bytes that were waiting */
+#define OUTQ_CLOCK 1 /* payload is a clocksync_sample_t */
+#define OUTQ_TICK 2  /* a poll without terminal data, for the line timestamps */
+
+rtt_session_t rtt; /* probe connection and control block, see rtt.h */
+int polled_data = 0; /* the poll sink received data */
+int term_polled = 0; /* the terminal channel brought data in the last poll */
+
+volatile sig_atomic_t capt_signal = 0;
 
 struct termios orig_termios;
 
-const char anim[4] = {'|', '/', '-', '\\'};
-int anim_index = 0;
-
 char txbuff[128];
 int txbuff_len = 0;
 
-int close_device(void)
+/* command line configuration */
+int opt_channel = 0;            // up/down channel used for the terminal
+int opt_channel_set = 0;        // --channel was given explicitly
+const char *opt_record = NULL;  // binary capture file, see capture.h
+const char *opt_replay = NULL;
+const char *opt_extract = NULL; // capture file to query, see capture_index.h
+double opt_from = 0;            // query window, in seconds from the start of the capture
+double opt_to = -1;
+const char *opt_flight = NULL;      // circular flight recorder file, see flight.h
+uint64_t opt_flight_size = 64;      // MB
+const char *opt_flight_dump = NULL;
+const char *opt_clock_check = NULL;
+uint32_t opt_trigger_ring = 0;      // bytes per channel, enables the pre-trigger capture, see trigger.h
+uint32_t opt_trigger_post = 64 * 1024;
+const char *opt_trigger_out = "trigger";
+const char *opt_trigger_pattern = NULL;
+const char *opt_trigger_regex = NULL;
+int opt_trigger_reset = 0;
+const char *opt_include[MATCH_MAX_PATTERNS]; // terminal filters, see filter.h
+const char *opt_exclude[MATCH_MAX_PATTERNS];
+const char *opt_highlight[MATCH_MAX_PATTERNS];
+int opt_include_cnt = 0, opt_exclude_cnt = 0, opt_highlight_cnt = 0;
+int opt_timestamps = -1;        // LINESTAMP_xxx, -1 = no line timestamps
+int opt_cyccnt = 0;             // sample the target cycle counter every poll, see clocksync.h
+const char *opt_profile_elf = NULL; // PC sampling profiler, see profiler.h
+const char *opt_profile_out = "profile";
+uint32_t opt_profile_rate = 10000;
+int opt_swo = 0;                // SWO/ITM capture, see swo.h
+uint32_t opt_swo_freq = 0;      // 0 = probe maximum
+uint32_t opt_swo_cpu = 0;       // core clock, 0 = measured with the cycle counter
+uint32_t opt_swo_ports = 0xFFFFFFFF;
+uint32_t opt_swd_khz = 0;       // SWD clock, 0 = library default
+int opt_swd_tune = 0;           // calibrate the SWD clock on every new connection, see swdclk.h
+const char *opt_elf = NULL;     // firmware symbols for --watch names (default: the --profile ELF)
+const char *opt_watch[WATCH_MAX_VARS]; // sampled variables, see watch.h
+int opt_watch_cnt = 0;
+uint32_t opt_watch_rate = 1000;
+const char *opt_watch_out = "watch.csv";
+const char *opt_jscope_out = NULL; // J-Scope channel decoder output, see jscope.h
+const char *opt_sysview = NULL;    // SystemView recordings prefix, see sysview.h
+int opt_defmt = 0;                 // the terminal channel carries deferred formatting messages, see deflog.h
+const char *opt_frame = NULL;      // framed binary channel, see frame.h
+int opt_headless = 0;              // no terminal: no raw mode, no spinner, status messages to a JSON log, see status.h
+const char *opt_log = NULL;        // status log of the headless mode (default stderr)
+uint32_t opt_io_ring = 8;          // MB, output queue to the sinks thread, 0 = sinks run in the poll loop
+int opt_usb_depth = 0;             // probe commands in flight, see usbpipe.h, 1 = blocking transfers, 0 = default
+int opt_workers = 0;               // threads of the channel decoders pool, 0 = decoders run on the output thread
+int opt_rack = 0;                  // every probe from one event loop into the --record capture, see reactor.h
+const char *opt_probe[REACTOR_MAX]; // serial numbers of the --rack probes, none = every connected one
+int opt_probe_cnt = 0;
+const char *opt_frame_udp = NULL;  // HOST:PORT the frames are sent to
+const char *opt_plugin[PLUGIN_MAX]; // channel decoders, see yastrtt_plugin.h
+int opt_plugin_cnt = 0;
+
+capture_writer_t recorder = {.fd = -1};
+flight_recorder_t flight = {0};
+trigger_t trig = {0};
+int reset_primed = 0; /* the first DHCSR read only clears a stale reset flag */
+filter_t term_filter = {0};
+linestamp_t term_stamp = {0};
+clocksync_t target_clock;
+profiler_t prof = {0};
+swo_t swo;
+int reset_seen = 0; /* S_RESET_ST was set in a DHCSR read, not yet reported */
+int swd_tuned = 0;
+watch_t watch;
+elf_symbols_t fw_symbols;
+jscope_t scope = {0};
+int jscope_channel = -1;
+char jscope_name[RTT_NAME_MAX];
+sysview_t sysview;
+int sysview_up = -1, sysview_down = -1;
+uint64_t sysview_next_ns = 0;
+deflog_t deflog = {0};
+frame_t framer = {0};
+int frame_udp = -1;
+plugin_host_t plugins;
+ioq_t outq; /* drained data on its way to the sinks thread */
+pool_t workers; /* channel decoders, one strand per channel */
+
+void close_device(void)
 {
-    if (sl)
+    if (rtt.sl)
     {
-        stlink_exit_debug_mode(sl);
-        stlink_close(sl);
-        sl = NULL;
+        swo_stop(&swo, rtt.sl);
+        rtt_close(&rtt);
     }
 }
 
-int read_mem(uint8_t *des, uint32_t addr, uint32_t len)
+/* Up channels read in this session */
+int channel_drained(void *ctx, int ch)
 {
-    uint32_t offset_addr = 0, offset_len, read_len;
+    /* When recording every up channel is drained, otherwise only the terminal one */
+    return (ch == opt_channel) || (ch == jscope_channel) || (ch == sysview_up) || (framer.active && (ch == framer.channel)) ||
+           (recorder.fd >= 0) || flight.active || trig.active || plugin_wants(&plugins, ch);
+}
 
-    // address and read len need to align to 4
-    read_len = len;
-    offset_addr = addr % 4;
-    if (offset_addr > 0)
-    {
-        addr -= offset_addr;
-        read_len += offset_addr;
-    }
-    offset_len = read_len % 4;
-    if (offset_len > 0)
-        read_len += (4 - offset_len);
+void stdout_sink(void *ctx, const uint8_t *buf, size_t len)
+{
+    fwrite(buf, 1, len, stdout);
+}
+
+/* Terminal output after the line timestamps, before stdout */
+void term_sink(void *ctx, const uint8_t *buf, size_t len)
+{
+    if (term_filter.active)
+        filter_write(&term_filter, buf, len);
+    else
+        stdout_sink(NULL, buf, len);
+}
 
-    // if ((stlink_status(sl) != 0) ||
-    //     (sl->core_stat != TARGET_RUNNING) ||
-    //     (stlink_read_mem32(sl, addr, read_len) != 0))
-    // {
-    //     printf("Error reading RAM!\n");
-    //     exit_clean(-1);
-    // }
-    /* No way of detecting if the target is still there, no error is returned, 
-     * the only way is to detect during connect, that's why we disconnect and 
-     * reconnect at every cycle */
-    stlink_read_mem32(sl, addr, read_len);
+/* Terminal channel data, first stage of the terminal pipeline */
+void term_output(const uint8_t *buf, uint32_t len, uint32_t avail, uint64_t now)
+{
+    if (term_stamp.active)
+        linestamp_write(&term_stamp, buf, len, avail, now);
+    else
+        term_sink(NULL, buf, len);
+}
 
-    // read data we actually need
-    for (uint32_t i = 0; i < len; i++)
-        des[i] = (uint8_t)sl->q_buf[i + offset_addr];
+/* Messages rendered by the deferred formatting decoder */
+void deflog_sink(void *ctx, const uint8_t *buf, size_t len, uint64_t ts_ns)
+{
+    term_output(buf, len, len, ts_ns);
+}
 
-    return 0;
+/* Channel decoders, run by the worker pool (in order for a channel) or in place */
+void task_jscope(void *ctx, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    jscope_feed((jscope_t *)ctx, buf, len, ts_ns);
 }
 
-int write_mem(uint8_t *buf, uint32_t addr, uint32_t len)
+void task_sysview(void *ctx, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
 {
-    for (uint32_t i = 0; i < len; i++)
-        sl->q_buf[i] = buf[i];
+    sysview_write((sysview_t *)ctx, buf, len);
+}
 
-    stlink_write_mem8(sl, addr, len);
+void task_plugin_data(void *ctx, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    plugin_pooled_data((plugin_host_t *)ctx, channel, buf, len, ts_ns);
+}
 
-    return 0;
+void task_plugin_frame(void *ctx, int channel, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    plugin_pooled_frame((plugin_host_t *)ctx, channel, buf, len, ts_ns);
 }
 
-/* buf = pointer to destination buffer
- * rtt_c = pointer to the updated copy of the channel ringbuffer control block
- * rtt_channel_addr = memory address on the target where the ringbuffer control block is located */
-int get_channel_data(uint8_t *buf, rtt_channel *rtt_c, uint32_t rtt_channel_addr)
+void run_decoder(pool_fn_t fn, void *ctx, int channel, const uint8_t *buf, uint32_t len, uint64_t now)
 {
-    uint32_t len;
+    if (workers.active)
+        pool_submit(&workers, channel, fn, ctx, buf, len, now);
+    else
+        fn(ctx, channel, buf, len, now);
+}
 
-    if (rtt_c->WrOff > rtt_c->RdOff)
+/* Frames of the --frame channel: kept in the recordings next to the raw data, sent as one datagram each,
+ * and shown in hex when it is the terminal channel */
+void frame_sink(void *ctx, const uint8_t *buf, uint32_t len, uint64_t ts_ns)
+{
+    if (recorder.fd >= 0)
     {
-        len = rtt_c->WrOff - rtt_c->RdOff;
-        read_mem(buf, rtt_c->pBuffer + rtt_c->RdOff, len);
-        rtt_c->RdOff += len;
-        write_mem((uint8_t *)&(rtt_c->RdOff), rtt_channel_addr + 4 * 4, 4);
-        return 1;
+        capture_write(&recorder, ts_ns, 0, framer.channel, CAPTURE_REC_FRAME, buf, len);
+    }
+
+    if (flight.active)
+    {
+        flight_write(&flight, ts_ns, 0, framer.channel, CAPTURE_REC_FRAME, buf, len);
     }
-    else if (rtt_c->WrOff < rtt_c->RdOff)
+
+    if (plugins.active)
     {
-        len = rtt_c->SizeOfBuffer - rtt_c->RdOff;
-        read_mem(buf, rtt_c->pBuffer + rtt_c->RdOff, len);
-        read_mem(buf + len, rtt_c->pBuffer, rtt_c->WrOff);
-        rtt_c->RdOff = rtt_c->WrOff;
-        write_mem((uint8_t *)&(rtt_c->RdOff), rtt_channel_addr + 4 * 4, 4);
-        return 1;
+        plugin_frame(&plugins, framer.channel, buf, len, ts_ns);
+        if (plugin_pooled(&plugins, YRTT_FRAMES, framer.channel))
+            run_decoder(task_plugin_frame, &plugins, framer.channel, buf, len, ts_ns);
     }
-    else
+
+    if (frame_udp >= 0)
     {
-        return 0;
+        /* nobody listening is not an error */
+        send(frame_udp, buf, len, MSG_DONTWAIT);
+    }
+
+    if (framer.channel == opt_channel)
+    {
+        char line[16 + FRAME_HEX_MAX * 3 + 8];
+        int n = sprintf(line, "[%u]", len);
+
+        for (uint32_t i = 0; (i < len) && (i < FRAME_HEX_MAX); i++)
+            n += sprintf(line + n, " %02x", buf[i]);
+        n += sprintf(line + n, (len > FRAME_HEX_MAX) ? " ...\n" : "\n");
+        term_output((const uint8_t *)line, n, n, ts_ns);
     }
 }
 
-/* txbuffer = pointer to the source data
- * txlength = length of the source data
- * rtt_c = pointer to the updated copy of the channel ringbuffer control block
- * rtt_channel_addr = memory address on the target where the ringbuffer control block is located */
-int write_channel_data(char *txbuffer, int txlength, rtt_channel *rtt_c, uint32_t rtt_channel_addr)
+/* spec = HOST:PORT */
+int open_frame_udp(const char *spec)
 {
-    int original_len = txlength;
+    const char *port = strrchr(spec, ':');
+    struct addrinfo hints = {0}, *res;
+    char host[256];
 
-    if (txlength == 0)
-        return 0;
+    if ((port == NULL) || (port - spec >= (long)sizeof(host)))
+        return -1;
+    memcpy(host, spec, port - spec);
+    host[port - spec] = 0;
+
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(host, port + 1, &hints, &res) != 0)
+        return -1;
+
+    frame_udp = socket(res->ai_family, SOCK_DGRAM, 0);
+    if ((frame_udp >= 0) && (connect(frame_udp, res->ai_addr, res->ai_addrlen) != 0))
+    {
+        close(frame_udp);
+        frame_udp = -1;
+    }
+    freeaddrinfo(res);
+    return (frame_udp >= 0) ? 0 : -1;
+}
 
-    /* we are ahead of the reading pointer, we are only limited by the size of the buffer */
-    if (rtt_c->WrOff >= rtt_c->RdOff)
+/* Everything drained from an up channel goes through here
+ * avail = bytes that were waiting in the channel when it was drained
+ * now = host time of the control block refresh that found them */
+void handle_up_data(int channel, const uint8_t *buf, uint32_t len, uint32_t avail, uint64_t now)
+{
+    if (recorder.fd >= 0)
     {
-        int to_write = txlength;
-        int avail = rtt_c->SizeOfBuffer - rtt_c->WrOff;
+        capture_write(&recorder, now, 0, channel, CAPTURE_REC_DATA, buf, len);
+    }
 
-        if (to_write > avail)
-        {
-            to_write = avail;
-        }
+    if (flight.active)
+    {
+        flight_write(&flight, now, 0, channel, CAPTURE_REC_DATA, buf, len);
+    }
 
-        write_mem((uint8_t *)txbuffer, rtt_c->pBuffer + rtt_c->WrOff, to_write);
-        txbuffer += to_write;
-        txlength -= to_write;
-        rtt_c->WrOff = (rtt_c->WrOff + to_write) % rtt_c->SizeOfBuffer; /* wrap to 0 if offset = size */
+    if (trig.active)
+    {
+        trigger_data(&trig, now, 0, channel, buf, len);
     }
 
-    if ((txlength > 0) && (rtt_c->WrOff < rtt_c->RdOff))
+    if (plugins.active)
     {
-        int to_write = txlength;
-        int avail = (rtt_c->RdOff - rtt_c->WrOff) -1;
+        plugin_data(&plugins, channel, buf, len, now);
+        if (plugin_pooled(&plugins, YRTT_DATA, channel))
+            run_decoder(task_plugin_data, &plugins, channel, buf, len, now);
+    }
 
-        if (to_write > avail)
-        {
-            to_write = avail;
-        }
+    if (channel == jscope_channel)
+    {
+        run_decoder(task_jscope, &scope, channel, buf, len, now);
+    }
+
+    if (channel == sysview_up)
+    {
+        run_decoder(task_sysview, &sysview, channel, buf, len, now);
+    }
+
+    if (framer.active && (channel == framer.channel))
+    {
+        frame_write(&framer, buf, len, now);
+    }
 
-        write_mem((uint8_t *)txbuffer, rtt_c->pBuffer + rtt_c->WrOff, to_write);
-        txbuffer += to_write;
-        txlength -= to_write;
-        rtt_c->WrOff += to_write;
+    if (channel == opt_channel)
+    {
+        if (deflog.active)
+            deflog_write(&deflog, buf, len, now);
+        else if (!framer.active || (framer.channel != opt_channel))
+            term_output(buf, len, avail, now);
+        fflush(stdout);
     }
+}
 
-    /* update the write offset on the target */
-    write_mem((uint8_t *)&(rtt_c->WrOff), rtt_channel_addr + (4 * 3), 4); 
+/* Flush what the sinks received in this poll */
+void commit_sinks(void)
+{
+    capture_commit(&recorder);
+    if (flight.active)
+        flight_commit(&flight);
+    trigger_commit(&trig);
+}
 
-    /* return the number of written bytes */
-    return (original_len - txlength); 
+/* Flush what the sinks received, when they run in the poll loop */
+void flush_sinks(void)
+{
+    if (!outq.active)
+        commit_sinks();
 }
 
-int Run_TXRX()
+/* Drained data leaves the poll loop here, for the sinks thread when there is one */
+void deliver_up_data(int channel, const uint8_t *buf, uint32_t len, uint32_t avail, uint64_t now)
+{
+    if (outq.active)
+        ioq_push(&outq, OUTQ_DATA, channel, now, avail, buf, len);
+    else
+        handle_up_data(channel, buf, len, avail, now);
+}
+
+/* Decoded ITM stimulus port data, merged with the RTT channels */
+void swo_sink(void *ctx, int port, const uint8_t *buf, uint32_t len)
 {
-    uint8_t rxbuf[1024];
+    deliver_up_data(SWO_CHANNEL(port), buf, len, len, timebase_now_ns());
+}
+
+/* Keep a cycle counter sample with the recorded data */
+void record_clock(const clocksync_sample_t *smp)
+{
+    if (recorder.fd >= 0)
+        capture_write(&recorder, smp->host_ns, 0, 0, CAPTURE_REC_CLOCK, (const uint8_t *)smp, sizeof(*smp));
+    if (flight.active)
+        flight_write(&flight, smp->host_ns, 0, 0, CAPTURE_REC_CLOCK, (const uint8_t *)smp, sizeof(*smp));
+}
+
+/* Output queue records, on the sinks thread */
+void outq_handler(void *ctx, const ioq_rec_t *rec, const uint8_t *payload)
+{
+    switch (rec->type)
+    {
+    case OUTQ_DATA:
+        handle_up_data(rec->channel, payload, rec->len, rec->avail, rec->ts_ns);
+        break;
+    case OUTQ_CLOCK:
+        record_clock((const clocksync_sample_t *)payload);
+        break;
+    case OUTQ_TICK:
+        linestamp_write(&term_stamp, payload, 0, 0, rec->ts_ns);
+        break;
+    }
+}
+
+void outq_idle(void *ctx)
+{
+    commit_sinks();
+}
 
-    /* update local copy of all ring-buffers control blocks */
-    read_mem(rxbuf, rtt_cb.cb_addr + 24, rtt_cb.cb_size - 24); /* 24 = cb name (16 bytes) + MaxNumUpBuffers (uint32, 4 bytes) + MaxNumDownBuffers (uint32, 4 bytes) = rbcb start */
-    memcpy(rtt_cb.aUp, rxbuf, rtt_cb.MaxNumUpBuffers * sizeof(rtt_channel));
-    memcpy(rtt_cb.aDown, rxbuf + (rtt_cb.MaxNumUpBuffers * sizeof(rtt_channel)), rtt_cb.MaxNumDownBuffers * sizeof(rtt_channel));
+/* Sample the target cycle counter and keep the samples with the recorded data, so that target
+ * timestamps can be converted offline too */
+void sample_target_clock(void)
+{
+    clocksync_sample_t smp;
+    int was_locked = target_clock.locked;
+
+    if (clocksync_sample(&target_clock, rtt.sl, &smp) == 0)
+        return;
 
-    memset(rxbuf, '\0', 1024);
+    if (outq.active)
+        ioq_push(&outq, OUTQ_CLOCK, 0, smp.host_ns, 0, (const uint8_t *)&smp, sizeof(smp));
+    else
+        record_clock(&smp);
 
-    /* the target's RAM address of the ringbuffer control block aUp[0] is the offset to the rbcb arrays */
-    if (get_channel_data(rxbuf, &rtt_cb.aUp[0], rtt_cb.cb_addr + 24) > 0)
+    if (target_clock.locked && !was_locked)
     {
-        printf("%s", rxbuf);
-        fflush(stdout);
+        status_info("Target clock locked: %.6f MHz, +/- %.1f us", clocksync_frequency(&target_clock) / 1e6,
+               target_clock.residual_ns / 1e3);
     }
+}
+
+/* Data drained by the RTT engine */
+void poll_sink(void *ctx, int channel, const uint8_t *buf, uint32_t len, uint32_t avail, uint64_t ts_ns)
+{
+    polled_data = 1;
+    if (channel == opt_channel)
+        term_polled = 1;
+    deliver_up_data(channel, buf, len, avail, ts_ns);
+}
+
+int Run_TXRX()
+{
+    term_polled = 0;
+    if (rtt_poll(&rtt) != 0)
+        return -1; /* nothing is released, the data will be read again */
+
+    if (!term_polled && term_stamp.active)
+    {
+        /* the interpolation needs every poll, not only the ones that brought data */
+        if (outq.active)
+            ioq_push(&outq, OUTQ_TICK, opt_channel, rtt.poll_ns, 0, NULL, 0);
+        else
+            linestamp_write(&term_stamp, (const uint8_t *)"", 0, 0, rtt.poll_ns);
+    }
+    flush_sinks();
 
-    if (txbuff_len > 0)
+    if ((txbuff_len > 0) && (opt_channel < rtt.cb.MaxNumDownBuffers))
     {
-        /* the target's RAM address of the ringbuffer control block aDown[0] is the offset to the rbcb arrays + the length of the aUp array of rbcb */
-        write_channel_data(txbuff, txbuff_len, &rtt_cb.aDown[0], rtt_cb.cb_addr + 24 + (rtt_cb.MaxNumUpBuffers * sizeof(rtt_channel)));
+        rtt_write(&rtt, opt_channel, (const uint8_t *)txbuff, txbuff_len);
         txbuff_len = 0;
         /* We are not dealing with remaining data that was not sent to the target and we just throw it away, this should not be an 
          * issue during normal usage as this data is only slow keyboard input and the target will likely consume it fast enough,
@@ -214,113 +474,303 @@ int Run_TXRX()
     return 0;
 }
 
-static stlink_t *stlink_open_first(void)
+/* Refresh and drain a single up channel, between two full polls */
+int poll_up_channel(int ch)
 {
-    stlink_t *sl = NULL;
-    sl = stlink_v1_open(0, 1);
-    if (sl == NULL)
-        sl = stlink_open_usb(0, CONNECT_HOT_PLUG, NULL, 0);
+    polled_data = 0;
+    if (rtt_poll_channel(&rtt, ch) != 0)
+        return -1;
 
-    return sl;
+    if (polled_data)
+        flush_sinks();
+    return 0;
+}
+
+/* Send a one byte SystemView host command */
+void sysview_command(uint8_t cmd)
+{
+    rtt_write(&rtt, sysview_down, &cmd, 1);
 }
 
+/* SIGINT (Ctrl+C) or SIGTERM (service stop), the main loop drains the target and exits */
 void handle_sigint(int sig)
 {
-    printf("Caught signal %d\n", sig);
     capt_signal = sig;
 }
 
 int open_device(void)
 {
-    sl = stlink_open_first();
+    int err = rtt_open(&rtt);
 
-    if (sl == NULL)
+    if (err == RTT_NO_PROBE)
     {
-        printf("STLink not detected %c     \r", anim[anim_index]);
-        fflush(stdout);
+        status_progress("STLink not detected");
+        return -1;
+    }
+
+    if (err == RTT_NO_TARGET)
+    {
+        status_progress("Target not detected");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Every DHCSR read clears the sticky reset flag, so they all go through here */
+int read_dhcsr(uint32_t *dhcsr)
+{
+    if (stlink_read_debug32(rtt.sl, DHCSR, dhcsr) != 0)
         return -1;
+
+    if (*dhcsr & DHCSR_S_RESET_ST)
+        reset_seen = 1;
+    return 0;
+}
+
+/* Returns 1 if the target core has been reset since the last call */
+int check_target_reset(void)
+{
+    uint32_t dhcsr = 0;
+    int reset;
+
+    if (read_dhcsr(&dhcsr) != 0)
+        return 0;
+
+    reset = reset_seen;
+    reset_seen = 0;
+    if (!reset_primed)
+    {
+        reset_primed = 1;
+        return 0;
     }
 
-    sl->verbose = 0;
+    return reset;
+}
+
+/* A held session (SWO) is not reopened every cycle, make sure the probe and the target still answer */
+int session_alive(void)
+{
+    uint32_t dhcsr = 0;
+
+    return (read_dhcsr(&dhcsr) == 0);
+}
+
+/* Pick the fastest stable SWD clock for this probe, cable and target, it is then used for every connection */
+void tune_swd_clock(void)
+{
+    swdclk_result_t res;
 
-    if (stlink_current_mode(sl) == STLINK_DEV_DFU_MODE)
+    swd_tuned = 1;
+    if ((rtt.sl->flash_size < SWDCLK_BLOCK) || (swdclk_calibrate(rtt.sl, rtt.sl->flash_base, &res) != 0))
     {
-        stlink_exit_dfu_mode(sl);
+        status_info("SWD clock calibration failed, keeping the default clock");
+        return;
     }
 
-    if (stlink_current_mode(sl) != STLINK_DEV_DEBUG_MODE)
+    for (int i = 0; i < res.steps; i++)
     {
-        stlink_enter_swd_mode(sl);
+        status_info("SWD %5u kHz: %7.1f KB/s, %u/%u bad reads", res.khz[i], res.bytes_per_s[i] / 1024,
+               res.errors[i], SWDCLK_ROUNDS);
     }
+    status_info("SWD clock set to %u kHz", res.best_khz);
+    opt_swd_khz = res.best_khz;
+    rtt.swd_khz = opt_swd_khz;
+    xfer_caps(&rtt.caps, rtt.sl, opt_swd_khz);
+}
+
+/* Configure the SWO output once the core clock is known */
+void start_swo(void)
+{
+    uint32_t cpu_hz = opt_swo_cpu;
+    int err;
 
-    /* That's how we know the STLINK lib has not detected a target */
-    if (sl->sram_size == 0)
+    if ((cpu_hz == 0) && target_clock.locked)
+        cpu_hz = (uint32_t)(clocksync_frequency(&target_clock) + 0.5);
+    if (cpu_hz == 0)
+        return; /* wait for the cycle counter to lock */
+
+    err = swo_configure(&swo, rtt.sl, cpu_hz);
+    if (err == -2)
     {
-        printf("Target not detected %c      \r", anim[anim_index]);
-        fflush(stdout);
-        return -1;
+        status_info("This probe has no SWO trace support");
+        swo.active = 0;
+    }
+    else if (err == 0)
+    {
+        status_info("SWO capture at %u bit/s, core clock %u Hz", swo.baud, cpu_hz);
     }
+}
 
-    /* The target is not reset/stopped at any moment 
-     * (checked with a logic analyzer on a Nucleo G071 board) */
-    /* but we set it to run anyway */
-    stlink_run(sl, RUN_NORMAL);
-    return 0;
+/* The session is kept open between cycles for the continuous idle time users */
+int session_held(void)
+{
+    return swo.configured || watch.active || (sysview_up >= 0);
 }
 
-void locate_rtt_cb(void)
+/* Idle time until the next RTT poll, on the same connection: keep the probe trace buffer empty, sample
+ * the watched variables on their grid, drain the SystemView channel and sample the PC in between */
+void run_idle(uint64_t until_ns)
+{
+    uint64_t now = timebase_now_ns();
+
+    while (rtt.sl && (now < until_ns))
+    {
+        uint64_t slice = until_ns;
+
+        if (swo.configured)
+        {
+            if (swo_poll(&swo, rtt.sl) != 0)
+            {
+                close_device();
+                break;
+            }
+            flush_sinks();
+            if (slice > now + SWO_POLL_US * 1000ull)
+                slice = now + SWO_POLL_US * 1000ull;
+        }
+
+        if (watch.active)
+        {
+            if (watch_sample(&watch, rtt.sl, &rtt.caps, now) != 0)
+            {
+                close_device();
+                break;
+            }
+            if (slice > watch.next_ns)
+                slice = watch.next_ns;
+        }
+
+        if (sysview_up >= 0)
+        {
+            if (now >= sysview_next_ns)
+            {
+                if (poll_up_channel(sysview_up) != 0)
+                {
+                    close_device();
+                    break;
+                }
+                sysview_next_ns = now + SYSVIEW_POLL_US * 1000ull;
+            }
+            if (slice > sysview_next_ns)
+                slice = sysview_next_ns;
+        }
+
+        if (prof.active)
+        {
+            profiler_run(&prof, rtt.sl, slice);
+        }
+        else
+        {
+            now = timebase_now_ns();
+            if (now < slice)
+                usleep((slice - now) / 1000);
+        }
+        now = timebase_now_ns();
+    }
+}
+
+/* Announce the named channels of a new control block */
+void print_channel_names(void)
 {
-    // read the whole RAM
-    uint8_t *buf = (uint8_t *)malloc(sl->sram_size);
-    uint32_t r_cnt = sl->sram_size / 0x400;
-    //printf("target have %u k ram\n\r", r_cnt);
-    for (uint32_t i = 0; i < r_cnt; i++)
+    for (int ch = 0; ch < rtt.cb.MaxNumUpBuffers; ch++)
     {
-        stlink_read_mem32(sl, 0x20000000 + i * 0x400, 0x400);
-        for (uint32_t k = 0; k < 0x400; k++)
-            (buf + i * 0x400)[k] = (uint8_t)(sl->q_buf[k]);
+        if (rtt.up_name[ch][0])
+            status_info("Up channel %d: %s", ch, rtt.up_name[ch]);
     }
+}
 
-    /* Reset the Control Block */
-    rtt_cb.cb_addr = 0;
-    free(rtt_cb.aUp); /* freeing NULL is allowed */
-    rtt_cb.aUp = NULL;
-    free(rtt_cb.aDown);
-    rtt_cb.aDown = NULL;
+/* Attach the J-Scope decoder to the channel announcing the format, it stays on the same stream
+ * across target resets */
+void attach_jscope(void)
+{
+    jscope_channel = -1;
 
-    // find SEGGER_RTT_CB address
-    uint32_t offset;
-    for (offset = 0; offset < sl->sram_size - 16; offset++)
+    for (int ch = 0; ch < rtt.cb.MaxNumUpBuffers; ch++)
     {
-        if (strncmp((char *)&buf[offset], "SEGGER RTT", 16) == 0)
+        if (!jscope_match(rtt.up_name[ch]))
+            continue;
+
+        if (!scope.active && (scope.records == 0))
         {
-            rtt_cb.cb_addr = 0x20000000 + offset;
-            printf("=> RTT addr = 0x%x         \n\r", rtt_cb.cb_addr);
-            fflush(stdout);
-            break;
+            if (jscope_open(&scope, rtt.up_name[ch], opt_jscope_out) != 0)
+            {
+                status_info("Unable to decode %s into %s", rtt.up_name[ch], opt_jscope_out);
+                return;
+            }
+            strcpy(jscope_name, rtt.up_name[ch]);
+        }
+        else if (strcmp(jscope_name, rtt.up_name[ch]) != 0)
+        {
+            status_info("J-Scope format changed to %s, decoder stopped", rtt.up_name[ch]);
+            jscope_close(&scope);
+            return;
         }
+
+        jscope_resync(&scope);
+        jscope_channel = ch;
+        return;
+    }
+}
+
+/* Start a SystemView recording when the target has both SysView channels, a new file for every time
+ * the CB is found since the target starts a new stream */
+void attach_sysview(void)
+{
+    sysview_up = -1;
+    sysview_down = -1;
+    sysview_stop(&sysview);
+
+    for (int ch = 0; ch < rtt.cb.MaxNumUpBuffers; ch++)
+    {
+        if (strcmp(rtt.up_name[ch], SYSVIEW_CHANNEL_NAME) == 0)
+            sysview_up = ch;
+    }
+    for (int ch = 0; ch < rtt.cb.MaxNumDownBuffers; ch++)
+    {
+        if (strcmp(rtt.down_name[ch], SYSVIEW_CHANNEL_NAME) == 0)
+            sysview_down = ch;
     }
 
-    if (rtt_cb.cb_addr == 0)
+    if ((sysview_up < 0) || (sysview_down < 0) || (sysview_start(&sysview, rtt.cb.cb_addr, sysview_up) != 0))
     {
-        printf("Searching SEGGER_RTT_CB %c        \r", anim[anim_index]);
-        fflush(stdout);
+        sysview_up = -1;
+        sysview_down = -1;
+        return;
+    }
+
+    sysview_command(SYSVIEW_CMD_START);
+}
+
+void locate_rtt_cb(void)
+{
+    /* the decoders are reset and reattached here, the sinks thread and the workers must be idle */
+    ioq_sync(&outq);
+    pool_sync(&workers);
+
+    /* Reset what was attached to the previous Control Block */
+    jscope_channel = -1;
+    deflog_reset(&deflog);
+    frame_reset(&framer);
+    sysview_up = -1;
+    sysview_down = -1;
+
+    if (rtt_locate(&rtt) != RTT_OK)
+    {
+        status_progress("Searching SEGGER_RTT_CB");
     }
     else
     {
-        // get SEGGER_RTT_CB content
-        memcpy(rtt_cb.acID, ((rtt_cb_t *)(buf + offset))->acID, 16);
-        rtt_cb.MaxNumUpBuffers = ((rtt_cb_t *)(buf + offset))->MaxNumUpBuffers;
-        rtt_cb.MaxNumDownBuffers = ((rtt_cb_t *)(buf + offset))->MaxNumDownBuffers;
-        rtt_cb.cb_size = 24 + (rtt_cb.MaxNumUpBuffers + rtt_cb.MaxNumDownBuffers) * sizeof(rtt_cb);
-        rtt_cb.aUp = (rtt_channel *)malloc(rtt_cb.MaxNumUpBuffers * sizeof(rtt_channel));
-        rtt_cb.aDown = (rtt_channel *)malloc(rtt_cb.MaxNumDownBuffers * sizeof(rtt_channel));
-        memcpy(rtt_cb.aUp, buf + offset + 24, rtt_cb.MaxNumUpBuffers * sizeof(rtt_channel));
-        memcpy(rtt_cb.aDown, buf + offset + 24 + rtt_cb.MaxNumUpBuffers * sizeof(rtt_channel),
-               rtt_cb.MaxNumDownBuffers * sizeof(rtt_channel));
+        status_progress(NULL);
+        status_info("RTT addr = 0x%x", rtt.cb.cb_addr);
+
+        print_channel_names();
+        plugin_restart(&plugins);
+        if (opt_jscope_out && (scope.active || (scope.records == 0)))
+            attach_jscope();
+        if (opt_sysview)
+            attach_sysview();
     }
-
-    free(buf);
 }
 
 void disableRawMode()
@@ -339,60 +789,934 @@ void enableRawMode()
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
 }
 
-int main(int ac, char **av)
+/* Write the payload of every data record of the selected channel to stdout */
+int replay_capture(const char *path)
 {
-    signal(SIGINT, handle_sigint);
+    capture_map_t map;
+    const capture_record_t *rec;
+    uint64_t offset = 0;
 
-    enableRawMode();
+    if (capture_map(&map, path) != 0)
+    {
+        printf("Unable to open capture file %s\n", path);
+        return -1;
+    }
 
-    while (1)
+    while ((rec = capture_next(&map, &offset)) != NULL)
     {
-        if (capt_signal == SIGINT)
-        {
-            close_device();
+        if ((rec->type == CAPTURE_REC_DATA) && (rec->channel == opt_channel))
+            fwrite(capture_payload(rec), 1, rec->length, stdout);
+    }
 
-            free(rtt_cb.aUp); /* freeing NULL is allowed */
-            rtt_cb.aUp = NULL;
-            free(rtt_cb.aDown);
-            rtt_cb.aDown = NULL;
+    capture_unmap(&map);
+    return 0;
+}
 
-            break;
-        }
+static int extract_to_stdout(void *ctx, const capture_record_t *rec)
+{
+    if (rec->type == CAPTURE_REC_DATA)
+        fwrite(capture_payload(rec), 1, rec->length, stdout);
+    return 0;
+}
 
-        /* raw input capture from terminal */
-        char c;
-        while (read(STDIN_FILENO, &c, 1) == 1)
-        {
-            if (txbuff_len < sizeof(txbuff))
-            {
-                txbuff[txbuff_len++] = c;
-            }
-        }
+static int extract_to_capture(void *ctx, const capture_record_t *rec)
+{
+    return capture_write((capture_writer_t *)ctx, rec->timestamp_ns, rec->probe, rec->channel, rec->type,
+                         capture_payload(rec), rec->length);
+}
 
-        if (open_device() == 0)
-        {
-            if (rtt_cb.cb_addr == 0)
-            {
-                locate_rtt_cb();
+/* Extract a time window (and optionally a single channel) of a capture file using its index,
+ * the records are copied into a new capture when --record is given, otherwise the payload of the
+ * selected channel is printed */
+int extract_capture(const char *path)
+{
+    capture_map_t map;
+    capture_index_t idx;
+    capture_writer_t out;
+    uint64_t from, to;
+    int has_index;
 
-                /* We ignore anything that was input by the user while no RTT was available */
-                txbuff_len = 0;
-            }
+    if (capture_map(&map, path) != 0)
+    {
+        printf("Unable to open capture file %s\n", path);
+        return -1;
+    }
 
-            if (rtt_cb.cb_addr != 0)
-            {
-                Run_TXRX();
-            }
+    has_index = (capture_index_map(&idx, path) == 0);
+    if (!has_index)
+        printf("No index for %s, scanning the whole capture\n", path);
+
+    from = map.hdr->start_mono_ns + (uint64_t)(opt_from * 1e9);
+    to = (opt_to < 0) ? UINT64_MAX : map.hdr->start_mono_ns + (uint64_t)(opt_to * 1e9);
+
+    if (opt_record)
+    {
+        if (capture_open_at(&out, opt_record, map.hdr->start_mono_ns, map.hdr->start_real_ns) != 0)
+        {
+            printf("Unable to create capture file %s\n", opt_record);
         }
         else
         {
-            /* We also need to relocate the CB when we lost connection to the target */
-            rtt_cb.cb_addr = 0;
+            capture_query(&map, has_index ? &idx : NULL, from, to, opt_channel_set ? opt_channel : -1,
+                          extract_to_capture, &out);
+            capture_close(&out);
+        }
+    }
+    else
+    {
+        capture_query(&map, has_index ? &idx : NULL, from, to, opt_channel, extract_to_stdout, NULL);
+    }
+
+    if (has_index)
+        capture_index_unmap(&idx);
+    capture_unmap(&map);
+    return 0;
+}
+
+/* Rebuild the clock model from the CAPTURE_REC_CLOCK samples of a capture and check the target to
+ * host conversion against them: every sample is converted from its 32 bit cycle count with the model
+ * of the previous samples, before it is added, and compared with the host time it was taken at */
+int check_clock(const char *path)
+{
+    capture_map_t map;
+    const capture_record_t *rec;
+    uint64_t offset = 0, samples = 0, checked = 0;
+    double sum = 0, sum2 = 0, max = 0;
+    clocksync_t cs;
+
+    if (capture_map(&map, path) != 0)
+    {
+        printf("Unable to open capture file %s\n", path);
+        return -1;
+    }
+
+    clocksync_init(&cs);
+    clocksync_set_wall(&cs, map.hdr->start_mono_ns, map.hdr->start_real_ns);
+
+    while ((rec = capture_next(&map, &offset)) != NULL)
+    {
+        clocksync_sample_t smp;
+        uint32_t resets = cs.resets;
+
+        if ((rec->type != CAPTURE_REC_CLOCK) || (rec->length < sizeof(smp)))
+            continue;
+
+        memcpy(&smp, capture_payload(rec), sizeof(smp));
+        samples++;
+
+        if (cs.locked && (smp.cycles >= cs.last_cycles))
+        {
+            uint64_t host_ns = clocksync_target_to_host(&cs, (uint32_t)smp.cycles);
+            double err = fabs((double)(int64_t)(host_ns - smp.host_ns));
+
+            clocksync_add(&cs, &smp);
+            if (cs.resets != resets)
+                continue; // the counter restarted, nothing to compare with
+            checked++;
+            sum += err;
+            sum2 += err * err;
+            if (err > max)
+                max = err;
+        }
+        else
+        {
+            clocksync_add(&cs, &smp);
+        }
+    }
+
+    if (checked == 0)
+    {
+        printf("%s: %llu clock samples, not enough to check the conversion\n", path, (unsigned long long)samples);
+    }
+    else
+    {
+        time_t wall = (time_t)(clocksync_target_to_wall(&cs, cs.last_raw) / 1000000000ULL);
+        char buf[32];
+
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&wall));
+        printf("%s: %llu clock samples, %u counter restarts, target clock %.0f Hz\n", path,
+               (unsigned long long)samples, cs.resets, clocksync_frequency(&cs));
+        printf("target to host error over %llu samples: mean %.0f ns, rms %.0f ns, max %.0f ns (fit residual %.0f ns)\n",
+               (unsigned long long)checked, sum / checked, sqrt(sum2 / checked), max, cs.residual_ns);
+        printf("last sample: cycle %llu at %s\n", (unsigned long long)cs.last_cycles, buf);
+    }
+
+    capture_unmap(&map);
+    return 0;
+}
+
+static void rack_sink(void *ctx, int channel, const uint8_t *buf, uint32_t len, uint32_t avail, uint64_t ts_ns)
+{
+    capture_write(&recorder, ts_ns, (uint16_t)(intptr_t)ctx, channel, CAPTURE_REC_DATA, buf, len);
+}
+
+static void rack_event(void *ctx, int index, int result)
+{
+    rtt_session_t *s = &((rtt_session_t *)ctx)[index];
+
+    switch (result)
+    {
+    case RTT_OK:
+        status_info("Probe %d (%s): RTT control block at 0x%08x, %d up channels", index, s->serial, s->cb.cb_addr,
+                    s->cb.MaxNumUpBuffers);
+        break;
+    case RTT_NO_PROBE:
+        status_info("Probe %d (%s): not connected", index, s->serial);
+        break;
+    case RTT_NO_TARGET:
+        status_info("Probe %d (%s): no target", index, s->serial);
+        break;
+    case RTT_SEARCHING:
+        status_info("Probe %d (%s): searching the RTT control block", index, s->serial);
+        break;
+    case RTT_LOST:
+        status_info("Probe %d (%s): connection lost", index, s->serial);
+        break;
+    }
+}
+
+/* Poll every probe (the --probe ones, or all the connected V2/V3 probes) from one event loop and record
+ * their up channels into the --record capture, the probe index goes in every record */
+int run_rack(void)
+{
+    static rtt_session_t boards[REACTOR_MAX];
+    reactor_t rack;
+    int count = 0;
+
+    if (opt_probe_cnt > 0)
+    {
+        for (int i = 0; i < opt_probe_cnt; i++)
+        {
+            rtt_init(&boards[count], opt_swd_khz, rack_sink, (void *)(intptr_t)count);
+            snprintf(boards[count].serial, sizeof(boards[count].serial), "%s", opt_probe[i]);
+            count++;
+        }
+    }
+    else
+    {
+        stlink_t **probes = NULL;
+        size_t found = stlink_probe_usb(&probes, CONNECT_HOT_PLUG, opt_swd_khz);
+
+        for (size_t i = 0; (i < found) && (count < REACTOR_MAX); i++)
+        {
+            rtt_init(&boards[count], opt_swd_khz, rack_sink, (void *)(intptr_t)count);
+            snprintf(boards[count].serial, sizeof(boards[count].serial), "%s", probes[i]->serial);
+            count++;
+        }
+        stlink_probe_usb_free(&probes, found);
+    }
+    if (count == 0)
+    {
+        printf("No probe found\n");
+        return -1;
+    }
+
+    reactor_init(&rack, RACK_POLL_US, 0, rack_event, boards);
+    for (int i = 0; i < count; i++)
+    {
+        boards[i].usb_depth = opt_usb_depth ? opt_usb_depth : RACK_USB_DEPTH;
+        reactor_add(&rack, &boards[i]);
+    }
+    status_info("Rack of %d probes, recording into %s", count, opt_record);
+
+    signal(SIGINT, handle_sigint);
+    signal(SIGTERM, handle_sigint);
+    while (capt_signal == 0)
+    {
+        reactor_run(&rack, RACK_POLL_US / 1000);
+        capture_commit(&recorder);
+    }
+    status_info("Caught signal %d", (int)capt_signal);
+
+    reactor_close(&rack);
+    for (int i = 0; i < count; i++)
+    {
+        status_info("Probe %d (%s): %llu bytes in %llu polls", i, boards[i].serial,
+                    (unsigned long long)rack.slot[i].bytes, (unsigned long long)rack.slot[i].polls);
+        rtt_free(&boards[i]);
+    }
+    capture_close(&recorder);
+    return 0;
+}
+
+/* Print (or convert into a capture with --record) the history kept in a flight recorder file, oldest first */
+int dump_flight(const char *path)
+{
+    flight_recorder_t f;
+    capture_writer_t out = {.fd = -1};
+    const capture_record_t *rec;
+    uint64_t pos = 0;
+
+    if (flight_map(&f, path) != 0)
+    {
+        printf("Unable to open flight recorder file %s\n", path);
+        return -1;
+    }
+
+    if (opt_record && (capture_open_at(&out, opt_record, f.hdr.start_mono_ns, f.hdr.start_real_ns) != 0))
+    {
+        printf("Unable to create capture file %s\n", opt_record);
+        flight_unmap(&f);
+        return -1;
+    }
+
+    while ((rec = flight_next(&f, &pos)) != NULL)
+    {
+        if (out.fd >= 0)
+        {
+            if (!opt_channel_set || (rec->channel == opt_channel))
+                capture_write(&out, rec->timestamp_ns, rec->probe, rec->channel, rec->type, capture_payload(rec), rec->length);
+        }
+        else if ((rec->type == CAPTURE_REC_DATA) && (rec->channel == opt_channel))
+        {
+            fwrite(capture_payload(rec), 1, rec->length, stdout);
+        }
+    }
+
+    capture_close(&out);
+    flight_unmap(&f);
+    return 0;
+}
+
+void usage(const char *name)
+{
+    printf("Usage: %s [options]\n"
+           "  -c, --channel N      up/down channel used for the terminal (default 0)\n"
+           "  -w, --record FILE    record every up channel into a binary capture file\n"
+           "  -r, --replay FILE    print the selected channel of a capture file and exit\n"
+           "  -x, --extract FILE   extract a time window of a capture file using its index and exit,\n"
+           "                       into a new capture with --record, or the selected channel to stdout\n"
+           "      --from SEC       start of the window, seconds from the start of the capture\n"
+           "      --to SEC         end of the window (default: end of the capture)\n"
+           "  -f, --flight FILE    keep the last --flight-size MB of every up channel in a circular file\n"
+           "      --flight-size MB size of the flight recorder data area (default 64)\n"
+           "      --flight-dump FILE print the flight recorder history (or save it with --record) and exit\n"
+           "      --trigger-ring BYTES keep the last BYTES of every up channel in memory, written to\n"
+           "                       <prefix>-NNNN.bin only when a trigger fires\n"
+           "      --trigger PATTERN  fire on a byte pattern (C escapes allowed)\n"
+           "      --trigger-regex RE fire on a line matching an extended regex\n"
+           "      --trigger-reset  fire when the target resets\n"
+           "      --trigger-post BYTES data captured after the trigger (default 65536)\n"
+           "      --trigger-out PREFIX dump file prefix (default trigger)\n"
+           "  -i, --include PATTERN  only show terminal lines containing one of the patterns\n"
+           "  -e, --exclude PATTERN  hide terminal lines containing one of the patterns\n"
+           "      --highlight PATTERN highlight the pattern in the terminal output\n"
+           "  -t, --timestamps[=wall] prefix terminal lines with the host receive time, in seconds\n"
+           "                       since start or as local wall clock time\n"
+           "      --cyccnt         sample the target DWT cycle counter every poll and correlate it\n"
+           "                       with the host clock (samples are kept in recordings)\n"
+           "      --clock-check FILE rebuild the clock model from the samples of a capture, check the\n"
+           "                       target to host time conversion against them and exit\n"
+           "  -p, --profile ELF    sample the target PC between polls and write a flat profile and\n"
+           "                       folded stacks symbolized against the firmware ELF\n"
+           "      --profile-out PREFIX output files prefix (default profile)\n"
+           "      --profile-rate HZ wanted sampling rate (default 10000)\n"
+           "      --swo            capture the ITM stimulus ports over SWO, port N is channel 128+N\n"
+           "                       (-c swoN shows it on the terminal), the probe session is kept open\n"
+           "      --swo-freq HZ    SWO bit rate (default: probe maximum)\n"
+           "      --swo-cpu HZ     target core clock (default: measured with --cyccnt)\n"
+           "      --swo-ports MASK enabled stimulus ports (default 0xFFFFFFFF)\n"
+           "      --swd-freq KHZ   SWD clock (default: library default)\n"
+           "      --swd-tune       measure every SWD clock against a flash block on each new connection\n"
+           "                       and keep the fastest one without errors\n"
+           "      --watch VAR[:TYPE] sample a variable (symbol name or address, type u8 i8 u16 i16 u32\n"
+           "                       i32 f32) between polls, the probe session is kept open\n"
+           "      --watch-rate HZ  sampling rate (default 1000)\n"
+           "      --watch-out FILE samples output, CSV if it ends in .csv, binary otherwise\n"
+           "                       (default watch.csv)\n"
+           "      --elf FILE       firmware ELF for the --watch names (default: the --profile one)\n"
+           "      --sysview PREFIX record the SysView channel into PREFIX-NNNN.SVDat, one file per target\n"
+           "                       run, the channel is drained every ms on a held probe session\n"
+           "      --defmt          the terminal channel carries deferred formatting messages (format\n"
+           "                       string ID and raw arguments), rendered with the strings of the\n"
+           "                       " DEFLOG_SECTION " section of the --elf firmware\n"
+           "      --jscope OUT     decode the JScope_<format> up channel (e.g. JScope_t4i4) into a CSV\n"
+           "                       file (OUT ending in .csv) or one array file per column OUT.<n>.<field>\n"
+           "      --frame CH:cobs|slip[:crc16|crc32][:seq]\n"
+           "                       split up channel CH into COBS or SLIP frames, checked against a\n"
+           "                       trailing CRC and/or a leading sequence byte, frames are kept in the\n"
+           "                       recordings (and shown in hex when CH is the terminal channel)\n"
+           "      --frame-udp HOST:PORT send every frame as a UDP datagram\n"
+           "      --plugin LIB[,ARGS] load a channel decoder plugin (shared object implementing\n"
+           "                       yastrtt_plugin.h), can be repeated\n"
+           "      --headless       run without a terminal (services, CI): no raw mode, no keyboard input,\n"
+           "                       no spinner, status messages as JSON lines in the log\n"
+           "      --log FILE       status log of --headless (default stderr)\n"
+           "      --io-ring MB     output queue between the probe poll loop and the sinks thread\n"
+           "                       (default 8), 0 runs the sinks in the poll loop\n"
+           "      --usb-depth N    probe commands kept in flight by the asynchronous USB transfers\n"
+           "                       (2 to 8), default 1: the blocking transfers (V1 probes always), 4 with --rack\n"
+           "      --workers N      run the J-Scope, SystemView and YRTT_PARALLEL plugin decoders on N\n"
+           "                       threads, each channel in order (default 0: on the output thread)\n"
+           "      --rack           poll every connected V2/V3 probe (or the --probe ones) from one event\n"
+           "                       loop and record all their up channels into the --record capture\n"
+           "      --probe SERIAL   probe of --rack, can be repeated\n"
+           "  -h, --help           show this help\n",
+           name);
+}
+
+int main(int ac, char **av)
+{
+    static const struct option long_opts[] = {
+        {"channel", required_argument, NULL, 'c'},
+        {"record", required_argument, NULL, 'w'},
+        {"replay", required_argument, NULL, 'r'},
+        {"extract", required_argument, NULL, 'x'},
+        {"from", required_argument, NULL, 1000},
+        {"to", required_argument, NULL, 1001},
+        {"flight", required_argument, NULL, 'f'},
+        {"flight-size", required_argument, NULL, 1002},
+        {"flight-dump", required_argument, NULL, 1003},
+        {"trigger-ring", required_argument, NULL, 1004},
+        {"trigger", required_argument, NULL, 1005},
+        {"trigger-regex", required_argument, NULL, 1006},
+        {"trigger-reset", no_argument, NULL, 1007},
+        {"trigger-post", required_argument, NULL, 1008},
+        {"trigger-out", required_argument, NULL, 1009},
+        {"include", required_argument, NULL, 'i'},
+        {"exclude", required_argument, NULL, 'e'},
+        {"highlight", required_argument, NULL, 1010},
+        {"timestamps", optional_argument, NULL, 't'},
+        {"cyccnt", no_argument, NULL, 1011},
+        {"clock-check", required_argument, NULL, 1037},
+        {"profile", required_argument, NULL, 'p'},
+        {"profile-out", required_argument, NULL, 1012},
+        {"profile-rate", required_argument, NULL, 1013},
+        {"swo", no_argument, NULL, 1014},
+        {"swo-freq", required_argument, NULL, 1015},
+        {"swo-cpu", required_argument, NULL, 1016},
+        {"swo-ports", required_argument, NULL, 1017},
+        {"swd-freq", required_argument, NULL, 1018},
+        {"swd-tune", no_argument, NULL, 1019},
+        {"watch", required_argument, NULL, 1020},
+        {"watch-rate", required_argument, NULL, 1021},
+        {"watch-out", required_argument, NULL, 1022},
+        {"elf", required_argument, NULL, 1023},
+        {"jscope", required_argument, NULL, 1024},
+        {"sysview", required_argument, NULL, 1025},
+        {"defmt", no_argument, NULL, 1026},
+        {"frame", required_argument, NULL, 1027},
+        {"frame-udp", required_argument, NULL, 1028},
+        {"plugin", required_argument, NULL, 1029},
+        {"headless", no_argument, NULL, 1030},
+        {"log", required_argument, NULL, 1031},
+        {"io-ring", required_argument, NULL, 1032},
+        {"usb-depth", required_argument, NULL, 1033},
+        {"rack", no_argument, NULL, 1034},
+        {"workers", required_argument, NULL, 1036},
+        {"probe", required_argument, NULL, 1035},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}};
+    int o;
+
+    while ((o = getopt_long(ac, av, "c:w:r:x:f:i:e:tp:h", long_opts, NULL)) != -1)
+    {
+        switch (o)
+        {
+        case 'c':
+            if (strncmp(optarg, "swo", 3) == 0)
+                opt_channel = SWO_CHANNEL(atoi(optarg + 3) % SWO_PORTS);
+            else
+                opt_channel = atoi(optarg);
+            opt_channel_set = 1;
+            break;
+        case 'w':
+            opt_record = optarg;
+            break;
+        case 'r':
+            opt_replay = optarg;
+            break;
+        case 'x':
+            opt_extract = optarg;
+            break;
+        case 1000:
+            opt_from = atof(optarg);
+            break;
+        case 1001:
+            opt_to = atof(optarg);
+            break;
+        case 'f':
+            opt_flight = optarg;
+            break;
+        case 1002:
+            opt_flight_size = strtoull(optarg, NULL, 0);
+            break;
+        case 1003:
+            opt_flight_dump = optarg;
+            break;
+        case 1004:
+            opt_trigger_ring = strtoul(optarg, NULL, 0);
+            break;
+        case 1005:
+            opt_trigger_pattern = optarg;
+            break;
+        case 1006:
+            opt_trigger_regex = optarg;
+            break;
+        case 1007:
+            opt_trigger_reset = 1;
+            break;
+        case 1008:
+            opt_trigger_post = strtoul(optarg, NULL, 0);
+            break;
+        case 1009:
+            opt_trigger_out = optarg;
+            break;
+        case 'i':
+            if (opt_include_cnt < MATCH_MAX_PATTERNS)
+                opt_include[opt_include_cnt++] = optarg;
+            break;
+        case 'e':
+            if (opt_exclude_cnt < MATCH_MAX_PATTERNS)
+                opt_exclude[opt_exclude_cnt++] = optarg;
+            break;
+        case 1010:
+            if (opt_highlight_cnt < MATCH_MAX_PATTERNS)
+                opt_highlight[opt_highlight_cnt++] = optarg;
+            break;
+        case 't':
+            opt_timestamps = (optarg && (strcmp(optarg, "wall") == 0)) ? LINESTAMP_WALL : LINESTAMP_REL;
+            break;
+        case 1011:
+            opt_cyccnt = 1;
+            break;
+        case 'p':
+            opt_profile_elf = optarg;
+            break;
+        case 1012:
+            opt_profile_out = optarg;
+            break;
+        case 1013:
+            opt_profile_rate = strtoul(optarg, NULL, 0);
+            break;
+        case 1014:
+            opt_swo = 1;
+            break;
+        case 1015:
+            opt_swo_freq = strtoul(optarg, NULL, 0);
+            break;
+        case 1016:
+            opt_swo_cpu = strtoul(optarg, NULL, 0);
+            break;
+        case 1017:
+            opt_swo_ports = strtoul(optarg, NULL, 0);
+            break;
+        case 1018:
+            opt_swd_khz = strtoul(optarg, NULL, 0);
+            break;
+        case 1019:
+            opt_swd_tune = 1;
+            break;
+        case 1020:
+            if (opt_watch_cnt < WATCH_MAX_VARS)
+                opt_watch[opt_watch_cnt++] = optarg;
+            break;
+        case 1021:
+            opt_watch_rate = strtoul(optarg, NULL, 0);
+            break;
+        case 1022:
+            opt_watch_out = optarg;
+            break;
+        case 1023:
+            opt_elf = optarg;
+            break;
+        case 1024:
+            opt_jscope_out = optarg;
+            break;
+        case 1025:
+            opt_sysview = optarg;
+            break;
+        case 1026:
+            opt_defmt = 1;
+            break;
+        case 1027:
+            opt_frame = optarg;
+            break;
+        case 1028:
+            opt_frame_udp = optarg;
+            break;
+        case 1029:
+            if (opt_plugin_cnt < PLUGIN_MAX)
+                opt_plugin[opt_plugin_cnt++] = optarg;
+            break;
+        case 1030:
+            opt_headless = 1;
+            break;
+        case 1031:
+            opt_log = optarg;
+            break;
+        case 1032:
+            opt_io_ring = strtoul(optarg, NULL, 0);
+            break;
+        case 1033:
+            opt_usb_depth = atoi(optarg);
+            if (opt_usb_depth < 1)
+                opt_usb_depth = 1;
+            break;
+        case 1034:
+            opt_rack = 1;
+            break;
+        case 1036:
+            opt_workers = atoi(optarg);
+            break;
+        case 1037:
+            opt_clock_check = optarg;
+            break;
+        case 1035:
+            if (opt_probe_cnt < REACTOR_MAX)
+                opt_probe[opt_probe_cnt++] = optarg;
+            break;
+        case 'h':
+            usage(av[0]);
+            return 0;
+        default:
+            usage(av[0]);
+            return 1;
+        }
+    }
+
+    if (opt_replay)
+    {
+        return (replay_capture(opt_replay) == 0) ? 0 : 1;
+    }
+
+    if (opt_clock_check)
+    {
+        return (check_clock(opt_clock_check) == 0) ? 0 : 1;
+    }
+
+    if (opt_extract)
+    {
+        return (extract_capture(opt_extract) == 0) ? 0 : 1;
+    }
+
+    if (opt_flight_dump)
+    {
+        return (dump_flight(opt_flight_dump) == 0) ? 0 : 1;
+    }
+
+    if (opt_rack && !opt_record)
+    {
+        printf("--rack records into the capture file given with --record\n");
+        return 1;
+    }
+
+    if (opt_record && (capture_open(&recorder, opt_record) != 0))
+    {
+        printf("Unable to create capture file %s\n", opt_record);
+        return 1;
+    }
+
+    if (opt_headless)
+    {
+        FILE *log = opt_log ? fopen(opt_log, "a") : NULL;
+
+        if (opt_log && (log == NULL))
+        {
+            printf("Unable to open %s\n", opt_log);
+            return 1;
+        }
+        status_init(1, log);
+    }
+
+    if (opt_rack)
+    {
+        return (run_rack() == 0) ? 0 : 1;
+    }
+
+    if (opt_flight && (flight_open(&flight, opt_flight, opt_flight_size * 1024 * 1024) != 0))
+    {
+        printf("Unable to open flight recorder file %s\n", opt_flight);
+        return 1;
+    }
+
+    if (opt_trigger_ring > 0)
+    {
+        if ((trigger_init(&trig, opt_trigger_out, opt_trigger_ring, opt_trigger_post) != 0) ||
+            (opt_trigger_pattern && (trigger_set_pattern(&trig, opt_trigger_pattern) != 0)) ||
+            (opt_trigger_regex && (trigger_set_regex(&trig, opt_trigger_regex) != 0)))
+        {
+            printf("Invalid trigger configuration\n");
+            return 1;
+        }
+        trig.on_reset = opt_trigger_reset;
+    }
+
+    if (opt_include_cnt + opt_exclude_cnt + opt_highlight_cnt > 0)
+    {
+        int err = filter_init(&term_filter, stdout_sink, NULL);
+
+        for (int i = 0; (err == 0) && (i < opt_include_cnt); i++)
+            err = filter_add_include(&term_filter, opt_include[i]);
+        for (int i = 0; (err == 0) && (i < opt_exclude_cnt); i++)
+            err = filter_add_exclude(&term_filter, opt_exclude[i]);
+        for (int i = 0; (err == 0) && (i < opt_highlight_cnt); i++)
+            err = filter_add_highlight(&term_filter, opt_highlight[i]);
+        if ((err != 0) || (filter_build(&term_filter) != 0))
+        {
+            printf("Invalid filter configuration (at most %d patterns)\n", MATCH_MAX_PATTERNS);
+            return 1;
+        }
+    }
+
+    clocksync_init(&target_clock);
+    rtt_init(&rtt, opt_swd_khz, poll_sink, NULL);
+    rtt.usb_depth = opt_usb_depth ? opt_usb_depth : 1;
+    rtt.drain = channel_drained;
+
+    if (opt_profile_elf && (profiler_init(&prof, opt_profile_elf, opt_profile_out, opt_profile_rate) != 0))
+    {
+        printf("Unable to load symbols from %s\n", opt_profile_elf);
+        return 1;
+    }
+
+    watch_init(&watch);
+    sysview_init(&sysview, opt_sysview);
+    if ((opt_watch_cnt > 0) || opt_defmt)
+    {
+        const char *elf_path = opt_elf ? opt_elf : opt_profile_elf;
+
+        if (elf_path && (elf_load(&fw_symbols, elf_path) != 0))
+        {
+            printf("Unable to load symbols from %s\n", elf_path);
+            return 1;
+        }
+        if (opt_defmt && (!elf_path || (deflog_init(&deflog, &fw_symbols, DEFLOG_SECTION, deflog_sink, NULL) != 0)))
+        {
+            printf("No %s format strings section, give the firmware with --elf\n", DEFLOG_SECTION);
+            return 1;
+        }
+    }
+    if (opt_watch_cnt > 0)
+    {
+        const char *elf_path = opt_elf ? opt_elf : opt_profile_elf;
+
+        for (int i = 0; i < opt_watch_cnt; i++)
+        {
+            if (watch_add(&watch, opt_watch[i], elf_path ? &fw_symbols : NULL) != 0)
+            {
+                printf("Invalid watch %s\n", opt_watch[i]);
+                return 1;
+            }
+        }
+        if (watch_open(&watch, opt_watch_out, opt_watch_rate) != 0)
+        {
+            printf("Unable to create %s\n", opt_watch_out);
+            return 1;
+        }
+    }
+
+    if (opt_frame && (frame_init(&framer, opt_frame, frame_sink, NULL) != 0))
+    {
+        printf("Invalid frame channel %s\n", opt_frame);
+        return 1;
+    }
+    if (opt_frame_udp && (open_frame_udp(opt_frame_udp) != 0))
+    {
+        printf("Unable to reach %s\n", opt_frame_udp);
+        return 1;
+    }
+
+    plugin_init(&plugins);
+    for (int i = 0; i < opt_plugin_cnt; i++)
+    {
+        if (plugin_load(&plugins, opt_plugin[i]) != 0)
+        {
+            printf("Unable to load plugin %s\n", opt_plugin[i]);
+            return 1;
+        }
+    }
+
+    if (opt_swo)
+    {
+        swo_init(&swo, opt_swo_ports, opt_swo_freq, swo_sink, NULL);
+        /* the TPIU prescaler needs the core clock */
+        if (opt_swo_cpu == 0)
+            opt_cyccnt = 1;
+    }
+
+    if (opt_timestamps >= 0)
+    {
+        linestamp_init(&term_stamp, opt_timestamps, term_sink, NULL);
+    }
+
+    /* the channel decoders get their own threads, before the output thread feeds them */
+    if ((opt_workers > 0) && (pool_init(&workers, opt_workers, POOL_PENDING_MAX) != 0))
+    {
+        printf("Unable to start %d workers (at most %d)\n", opt_workers, POOL_MAX_WORKERS);
+        return 1;
+    }
+    plugins.pooled = workers.active;
+
+    /* the sinks get their own thread, a slow terminal or disk doesn't delay the polls */
+    if ((opt_io_ring > 0) && (ioq_init(&outq, (uint64_t)opt_io_ring * 1024 * 1024, outq_handler, outq_idle, NULL) != 0))
+    {
+        printf("Unable to start the output thread\n");
+        return 1;
+    }
+
+    signal(SIGINT, handle_sigint);
+    signal(SIGTERM, handle_sigint);
+
+    /* without a terminal there is no raw mode to set (and no keyboard to read, a blocking read of a pipe
+     * would stall the polls) */
+    int keyboard = !opt_headless && isatty(STDIN_FILENO);
+    if (keyboard)
+    {
+        enableRawMode();
+    }
+
+    while (1)
+    {
+        if (capt_signal != 0)
+        {
+            status_info("Caught signal %d", (int)capt_signal);
+
+            /* what the target wrote until now still goes to the sinks, the session is usually closed
+             * between cycles: reopen it, the control block is still known */
+            if ((rtt.cb.cb_addr != 0) && (rtt.sl || (open_device() == 0)))
+            {
+                Run_TXRX();
+            }
+            if (outq.active && (outq.stalls > 0))
+            {
+                status_info("Output queue full %llu times (peak %llu KB), the sinks are slower than the target",
+                            (unsigned long long)outq.stalls, (unsigned long long)(outq.max_used / 1024));
+            }
+            ioq_stop(&outq);
+            if (workers.active)
+            {
+                uint64_t steals = 0;
+
+                for (int i = 0; i < workers.workers; i++)
+                    steals += workers.worker[i].steals;
+                status_info("%llu decoder tasks on %d workers, %llu stolen, queue full %llu times",
+                            (unsigned long long)workers.submitted, workers.workers, (unsigned long long)steals,
+                            (unsigned long long)workers.stalls);
+            }
+            pool_stop(&workers);
+
+            if (rtt.sl && (sysview_down >= 0))
+            {
+                sysview_command(SYSVIEW_CMD_STOP);
+            }
+            sysview_stop(&sysview);
+            close_device();
+
+            rtt_free(&rtt);
+
+            capture_close(&recorder);
+            flight_close(&flight);
+            trigger_close(&trig);
+            filter_free(&term_filter);
+            profiler_close(&prof);
+            if (watch.active)
+            {
+                status_info("%llu samples, %llu missed", (unsigned long long)watch.samples,
+                       (unsigned long long)watch.missed);
+            }
+            watch_close(&watch);
+            if (scope.records > 0)
+            {
+                status_info("%llu J-Scope records", (unsigned long long)scope.records);
+            }
+            jscope_close(&scope);
+            if (deflog.errors > 0)
+            {
+                status_info("%llu deferred log bytes skipped to resynchronize", (unsigned long long)deflog.errors);
+            }
+            if (framer.active)
+            {
+                status_info("%llu frames, %llu lost, %llu CRC errors, %llu malformed",
+                       (unsigned long long)framer.frames, (unsigned long long)framer.lost,
+                       (unsigned long long)framer.crc_errors, (unsigned long long)framer.dropped);
+            }
+            if (frame_udp >= 0)
+            {
+                close(frame_udp);
+            }
+            plugin_unload(&plugins);
+            elf_free(&fw_symbols);
+            break;
+        }
+
+        uint64_t cycle_start = timebase_now_ns();
+
+        /* raw input capture from terminal */
+        char c;
+        while (keyboard && (read(STDIN_FILENO, &c, 1) == 1))
+        {
+            if (txbuff_len < sizeof(txbuff))
+            {
+                txbuff[txbuff_len++] = c;
+            }
+        }
+
+        /* with SWO the session stays open between cycles */
+        if (rtt.sl && !session_alive())
+        {
+            close_device();
+        }
+
+        if (rtt.sl || (open_device() == 0))
+        {
+            if (opt_swd_tune && !swd_tuned)
+            {
+                tune_swd_clock();
+            }
+
+            if ((trig.on_reset || swo.active) && check_target_reset())
+            {
+                ioq_sync(&outq);
+                if (trig.on_reset)
+                    trigger_fire(&trig, timebase_now_ns(), "target reset");
+                /* the firmware may have reprogrammed the trace pins or the clocks */
+                swo_stop(&swo, rtt.sl);
+            }
+
+            if (opt_cyccnt)
+                sample_target_clock();
+
+            if (swo.active && !swo.configured)
+            {
+                start_swo();
+            }
+
+            if (rtt.cb.cb_addr == 0)
+            {
+                locate_rtt_cb();
+
+                /* We ignore anything that was input by the user while no RTT was available */
+                txbuff_len = 0;
+            }
+
+            if (rtt.cb.cb_addr != 0)
+            {
+                Run_TXRX();
+            }
+
+            if (swo.configured || watch.active || (sysview_up >= 0) || prof.active)
+            {
+                run_idle(cycle_start + POLL_INTERVAL_US * 1000ull);
+            }
+        }
+        else
+        {
+            /* We also need to relocate the CB when we lost connection to the target */
+            rtt_forget(&rtt);
+            /* and the cable or the target may have changed */
+            swd_tuned = 0;
+        }
+
+        if (!session_held())
+        {
+            close_device();
         }
 
-        close_device();
-        usleep(100000);
-        anim_index = (anim_index + 1) % sizeof(anim);
+        uint64_t elapsed_us = (timebase_now_ns() - cycle_start) / 1000;
+        if (elapsed_us < POLL_INTERVAL_US)
+            usleep(POLL_INTERVAL_US - elapsed_us);
+        status_tick();
     }
 
     return 0;
@@ -0,0 +1,74 @@
+#ifndef YASTRTT_PLUGIN_H
+#define YASTRTT_PLUGIN_H
+
+#include <stdint.h>
+
+/* Plugin ABI: a decoder is a shared object loaded with --plugin LIB[,ARGS], it exports
+ *
+ *   int yrtt_plugin_init(yrtt_host_t *host, const char *args);   0 = loaded, anything else = rejected
+ *   void yrtt_plugin_exit(void);                                  optional, called before unloading
+ *
+ * and registers its handlers from yrtt_plugin_init() with host->subscribe(). The handlers are called
+ * from the poll loop with spans pointing straight into the drained data: valid only during the call,
+ * never written. A plugin is built against this header only, e.g.
+ *
+ *   static void count(void *user, int channel, const yrtt_span_t *span, uint32_t count, uint64_t ts_ns)
+ *   {
+ *       for (uint32_t i = 0; i < count; i++)
+ *           *(uint64_t *)user += span[i].len;
+ *   }
+ *
+ *   int yrtt_plugin_init(yrtt_host_t *host, const char *args)
+ *   {
+ *       static uint64_t total;
+ *       yrtt_handler_t h = {sizeof(h), YRTT_DATA, count, NULL, &total};
+ *       return host->subscribe(host, atoi(args), &h);
+ *   }
+ *
+ *   gcc -shared -fPIC -o libcount.so count.c
+ *
+ * Compatibility: fields are only ever appended, host->abi changes when something else would, the
+ * size fields tell both sides which fields the other one knows. */
+
+#define YRTT_PLUGIN_ABI 1
+
+#define YRTT_ALL_CHANNELS -1
+
+/* yrtt_handler_t.flags */
+#define YRTT_DATA 0x1   /* raw data as drained from the channel, in order, in pieces of any size */
+#define YRTT_FRAMES 0x2 /* one call per checked frame of the --frame channel, see frame.h */
+/* the calls may come from a worker thread (--workers): the ones for a channel stay in order and never
+ * overlap, the ones for different channels may run at the same time (YRTT_ALL_CHANNELS handlers) */
+#define YRTT_PARALLEL 0x4
+
+typedef struct
+{
+    const uint8_t *data;
+    uint32_t len;
+} yrtt_span_t;
+
+typedef struct
+{
+    uint32_t size;  // sizeof(yrtt_handler_t) as seen by the plugin
+    uint32_t flags; // YRTT_DATA and/or YRTT_FRAMES, optionally YRTT_PARALLEL
+    /* channel = up channel index (SWO ports are 128 + port), ts_ns = host CLOCK_MONOTONIC of the poll */
+    void (*data)(void *user, int channel, const yrtt_span_t *span, uint32_t count, uint64_t ts_ns);
+    /* the target stream restarted (new control block), partial messages must be dropped, may be NULL */
+    void (*restart)(void *user, int channel);
+    void *user;
+} yrtt_handler_t;
+
+typedef struct yrtt_host
+{
+    uint32_t abi;  // YRTT_PLUGIN_ABI
+    uint32_t size; // sizeof(yrtt_host_t) as seen by yastrtt
+    /* channel = up channel or YRTT_ALL_CHANNELS, the handler is copied, returns 0 or -1 */
+    int (*subscribe)(struct yrtt_host *host, int channel, const yrtt_handler_t *handler);
+    /* message shown on the yastrtt console */
+    void (*log)(struct yrtt_host *host, const char *msg);
+} yrtt_host_t;
+
+typedef int (*yrtt_plugin_init_t)(yrtt_host_t *host, const char *args);
+typedef void (*yrtt_plugin_exit_t)(void);
+
+#endif